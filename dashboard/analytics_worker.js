@@ -0,0 +1,268 @@
+//dashboard analytics over typed arrays, runs in a Web Worker
+//events are two columns: ts (Int32Array, unix seconds, ascending) and
+//bits (Uint8Array, bit i set = event i is an entry)
+//the page also loads this file as a plain script for packEvents/percentile
+
+function isEntryAt(bits, i) {
+  return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+//[{timestamp, is_entry}] ascending -> typed columns
+function packEvents(eventsAsc) {
+  const n = eventsAsc.length;
+  const ts = new Int32Array(n);
+  const bits = new Uint8Array((n + 7) >> 3);
+  for (let i = 0; i < n; i++) {
+    ts[i] = eventsAsc[i].timestamp;
+    if (eventsAsc[i].is_entry) bits[i >> 3] |= 1 << (i & 7);
+  }
+  return { ts, bits, n };
+}
+
+//packed /getMovementsPacked/ body: uint32 n, n x int32 ts, ceil(n/8) entry bytes
+function unpackEvents(buffer) {
+  const n = new DataView(buffer).getUint32(0, true);
+  const ts = new Int32Array(buffer, 4, n);
+  const bits = new Uint8Array(buffer, 4 + 4 * n, (n + 7) >> 3);
+  return { ts, bits, n };
+}
+
+//first index with ts[i] >= value
+function lowerBound(ts, n, value) {
+  let lo = 0,
+    hi = n;
+  while (lo < hi) {
+    const mid = (lo + hi) >> 1;
+    if (ts[mid] < value) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+//local hour starts for `days` days from the local midnight firstDayStart, plus the end
+//built with Date once per hour instead of once per event, DST gaps give empty buckets
+function hourBoundaries(firstDayStart, days) {
+  const d0 = new Date(firstDayStart * 1000);
+  const y = d0.getFullYear(),
+    m = d0.getMonth(),
+    d = d0.getDate();
+  const out = new Float64Array(days * 24 + 1);
+  for (let day = 0; day < days; day++) {
+    for (let h = 0; h < 24; h++) {
+      out[day * 24 + h] = new Date(y, m, d + day, h).getTime() / 1000;
+    }
+  }
+  out[days * 24] = new Date(y, m, d + days).getTime() / 1000;
+  return out;
+}
+
+//entries/exits per bucket, one pointer walk over the sorted timestamps
+function countByBucket(ts, bits, n, bounds) {
+  const buckets = bounds.length - 1;
+  const entries = new Int32Array(buckets);
+  const exits = new Int32Array(buckets);
+  let i = lowerBound(ts, n, bounds[0]);
+  for (let b = 0; b < buckets; b++) {
+    const end = bounds[b + 1];
+    for (; i < n && ts[i] < end; i++) {
+      if (isEntryAt(bits, i)) entries[b]++;
+      else exits[b]++;
+    }
+  }
+  return { entries, exits };
+}
+
+//pair entries with the next exit, same rules as buildSessions on the page
+//state carries an open entry between calls
+function pairSessions(ts, bits, n, state = {}) {
+  const entry = new Int32Array((n >> 1) + 1);
+  const duration = new Int32Array((n >> 1) + 1);
+  let count = 0;
+  let inside = !!state.inside;
+  let entryTs = state.entryTs ?? 0;
+  for (let i = 0; i < n; i++) {
+    if (isEntryAt(bits, i)) {
+      //duplicate entry without exit -> reset to the latest entry
+      inside = true;
+      entryTs = ts[i];
+    } else if (inside && ts[i] > entryTs) {
+      entry[count] = entryTs;
+      duration[count] = ts[i] - entryTs;
+      count++;
+      inside = false;
+    }
+  }
+  state.inside = inside;
+  state.entryTs = inside ? entryTs : null;
+  return { entry, duration, count };
+}
+
+//k-th smallest in place, O(n) on average (Hoare selection)
+function selectKth(a, k) {
+  let lo = 0,
+    hi = a.length - 1;
+  while (lo < hi) {
+    const pivot = a[(lo + hi) >> 1];
+    let i = lo,
+      j = hi;
+    while (i <= j) {
+      while (a[i] < pivot) i++;
+      while (a[j] > pivot) j--;
+      if (i <= j) {
+        const t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+        i++;
+        j--;
+      }
+    }
+    if (k <= j) hi = j;
+    else if (k >= i) lo = i;
+    else break;
+  }
+  return a[k];
+}
+
+//same index rule as the old sort based percentile, without the sort
+function percentile(values, p) {
+  if (!values.length) return 0;
+  const copy = Float64Array.from(values);
+  const idx = Math.min(
+    copy.length - 1,
+    Math.max(0, Math.floor((p / 100) * copy.length))
+  );
+  return selectKth(copy, idx);
+}
+
+//single day: hourly entries/exits and dwell by hour of entry
+function computeDay(data, dayStart) {
+  const { ts, bits, n } = data;
+  const bounds = hourBoundaries(dayStart, 1);
+  const dayEnd = bounds[24] - 1;
+  const { entries, exits } = countByBucket(ts, bits, n, bounds);
+  let inCount = 0,
+    outCount = 0;
+  for (let h = 0; h < 24; h++) {
+    inCount += entries[h];
+    outCount += exits[h];
+  }
+
+  //pair over everything fetched, keep sessions fully inside the day
+  const pairing = {};
+  const s = pairSessions(ts, bits, n, pairing);
+  const counts = new Float64Array(24);
+  const sumMin = new Float64Array(24);
+  const durationsMin = new Float64Array(s.count);
+  let kept = 0,
+    h = 0;
+  //session entries ascend, so the hour pointer only moves forward
+  for (let k = 0; k < s.count; k++) {
+    const e = s.entry[k];
+    const dur = s.duration[k];
+    if (e < dayStart || e + dur > dayEnd || dur <= 0) continue;
+    while (h < 23 && e >= bounds[h + 1]) h++;
+    counts[h]++;
+    sumMin[h] += dur / 60;
+    durationsMin[kept++] = dur / 60;
+  }
+
+  return {
+    grouped: { entries, exits, inCount, outCount },
+    counts,
+    sumMin,
+    durationsMin: durationsMin.slice(0, kept),
+    pairing,
+  };
+}
+
+//several days: per day totals, average per hour for each weekday, daily dwell median
+function computeRange(data, firstDayStart, days) {
+  const { ts, bits, n } = data;
+  const bounds = hourBoundaries(firstDayStart, days);
+  const { entries, exits } = countByBucket(ts, bits, n, bounds);
+
+  const dayEntries = new Int32Array(days);
+  const dayExits = new Int32Array(days);
+  const weekdayEntries = new Float64Array(7 * 24);
+  const weekdayExits = new Float64Array(7 * 24);
+  const weekdayDays = new Int32Array(7);
+  for (let day = 0; day < days; day++) {
+    const wd = new Date(bounds[day * 24] * 1000).getDay();
+    weekdayDays[wd]++;
+    for (let h = 0; h < 24; h++) {
+      const b = day * 24 + h;
+      dayEntries[day] += entries[b];
+      dayExits[day] += exits[b];
+      weekdayEntries[wd * 24 + h] += entries[b];
+      weekdayExits[wd * 24 + h] += exits[b];
+    }
+  }
+  for (let wd = 0; wd < 7; wd++) {
+    if (!weekdayDays[wd]) continue;
+    for (let h = 0; h < 24; h++) {
+      weekdayEntries[wd * 24 + h] /= weekdayDays[wd];
+      weekdayExits[wd * 24 + h] /= weekdayDays[wd];
+    }
+  }
+
+  //median dwell per day from the sessions that start and end that day
+  const s = pairSessions(ts, bits, n, {});
+  const dayMedianMin = new Float64Array(days);
+  let k = 0;
+  for (let day = 0; day < days; day++) {
+    const start = bounds[day * 24];
+    const end = bounds[(day + 1) * 24];
+    while (k < s.count && s.entry[k] < start) k++;
+    const durations = [];
+    for (let j = k; j < s.count && s.entry[j] < end; j++) {
+      if (s.entry[j] + s.duration[j] < end && s.duration[j] > 0)
+        durations.push(s.duration[j] / 60);
+    }
+    dayMedianMin[day] = percentile(durations, 50);
+  }
+
+  return {
+    dayStarts: bounds.filter((_, i) => i % 24 === 0).slice(0, days),
+    dayEntries,
+    dayExits,
+    dayMedianMin,
+    weekdayEntries,
+    weekdayExits,
+    weekdayDays,
+  };
+}
+
+//worker side: datasets are loaded once (transferred), then queried by id
+if (
+  typeof WorkerGlobalScope !== "undefined" &&
+  self instanceof WorkerGlobalScope
+) {
+  const datasets = new Map();
+  self.onmessage = (e) => {
+    const msg = e.data;
+    const t0 = performance.now();
+    try {
+      let result;
+      if (msg.type === "load") {
+        const data = msg.packed
+          ? unpackEvents(msg.packed)
+          : { ts: msg.ts, bits: msg.bits, n: msg.n };
+        datasets.set(msg.dataset, data);
+        result = { n: data.n };
+      } else if (msg.type === "day") {
+        result = computeDay(datasets.get(msg.dataset), msg.dayStart);
+      } else if (msg.type === "range") {
+        result = computeRange(
+          datasets.get(msg.dataset),
+          msg.firstDayStart,
+          msg.days
+        );
+      } else {
+        throw new Error(`unknown request ${msg.type}`);
+      }
+      self.postMessage({ id: msg.id, result, ms: performance.now() - t0 });
+    } catch (err) {
+      self.postMessage({ id: msg.id, error: String(err?.message || err) });
+    }
+  };
+}
@@ -0,0 +1,99 @@
+#cold tier for movements: one compressed columnar file per device and month
+#layout before zlib: magic, uint32 count, uint32 first timestamp,
+#count varint timestamp deltas (ascending), then one bit per event (1 = entry)
+import calendar
+import functools
+import hashlib
+import os
+import struct
+import time
+import zlib
+
+MAGIC = b"RAM1"
+HEADER = struct.Struct("<4sII")
+
+
+#utc calendar month containing ts
+def month_start(ts):
+    t = time.gmtime(ts)
+    return calendar.timegm((t.tm_year, t.tm_mon, 1, 0, 0, 0))
+
+def next_month(ts):
+    t = time.gmtime(ts)
+    year, month = (t.tm_year + 1, 1) if t.tm_mon == 12 else (t.tm_year, t.tm_mon + 1)
+    return calendar.timegm((year, month, 1, 0, 0, 0))
+
+
+#rows are (timestamp, is_entry) sorted by timestamp
+def encode(rows):
+    n = len(rows)
+    first = rows[0][0] if n else 0
+    out = bytearray(HEADER.pack(MAGIC, n, first))
+
+    prev = first
+    for ts, _ in rows:
+        delta = ts - prev
+        prev = ts
+        while delta >= 0x80:
+            out.append((delta & 0x7F) | 0x80)
+            delta >>= 7
+        out.append(delta)
+
+    bits = bytearray((n + 7) // 8)
+    for i, (_, is_entry) in enumerate(rows):
+        if is_entry:
+            bits[i >> 3] |= 1 << (i & 7)
+    out += bits
+    return zlib.compress(bytes(out), 9)
+
+def decode(data):
+    raw = zlib.decompress(data)
+    magic, n, prev = HEADER.unpack_from(raw, 0)
+    if magic != MAGIC:
+        raise ValueError("not a movement archive")
+
+    timestamps = []
+    pos = HEADER.size
+    for _ in range(n):
+        shift = 0
+        delta = 0
+        while True:
+            byte = raw[pos]
+            pos += 1
+            delta |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                break
+            shift += 7
+        prev += delta
+        timestamps.append(prev)
+
+    bits = raw[pos:pos + (n + 7) // 8]
+    return [(ts, (bits[i >> 3] >> (i & 7)) & 1) for i, ts in enumerate(timestamps)]
+
+
+#api keys are secrets, so devices are named by a hash of the key outside the database
+def device_id(api_key):
+    return hashlib.sha1(api_key.encode()).hexdigest()[:16]
+
+def device_dir(root, api_key):
+    return os.path.join(root, device_id(api_key))
+
+#every rewrite gets a new file name, the db row pointing at it is the commit point
+def write_month(root, api_key, month, rows):
+    directory = device_dir(root, api_key)
+    os.makedirs(directory, exist_ok=True)
+    name = time.strftime("%Y-%m", time.gmtime(month)) + f".{time.time_ns():x}.mov"
+    path = os.path.join(directory, name)
+    tmp = path + ".tmp"
+    with open(tmp, "wb") as f:
+        f.write(encode(rows))
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp, path)
+    return path
+
+#files never change once written (rewrites get a new name), so decoded months can be cached
+@functools.lru_cache(maxsize=64)
+def read_month(path):
+    with open(path, "rb") as f:
+        return tuple(decode(f.read()))
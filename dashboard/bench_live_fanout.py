@@ -0,0 +1,104 @@
+#local fan-out benchmark of the /live/ hub
+#hundreds of in-process subscribers on one channel, ingest style publishes from a worker thread
+#usage: python dashboard/bench_live_fanout.py [--subscribers 500] [--messages 200] [--rate 50]
+import argparse
+import asyncio
+import json
+import os
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import main
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100 * len(values)))]
+
+
+def batch_payload(i):
+    #what publish_movements sends for a full 20 event batch
+    t = 1700000000 + i * 10
+    return {
+        "movements": [{"timestamp": t + j, "is_entry": j % 2 == 0} for j in range(20)],
+        "hours": [{"hour": t - t % 3600, "entries": 120 + i, "exits": 110 + i}],
+    }
+
+
+async def run(subscribers, messages, rate):
+    hub = main.LiveHub(main.liveQueueSize)
+    hub.loop = asyncio.get_running_loop()
+    channel = "device:bench"
+
+    sent_at = {}
+    last_seen = {}
+    received = [0]
+    resyncs = [0]
+    queues = []
+
+    async def subscriber():
+        queue = hub.subscribe(channel)
+        queues.append(queue)
+        try:
+            while True:
+                message = await queue.get()
+                if message.startswith("event: resync"):
+                    resyncs[0] += 1
+                    continue
+                data = json.loads(message.split("data: ", 1)[1])
+                seq = data["movements"][0]["timestamp"]
+                last_seen[seq] = time.perf_counter()
+                received[0] += 1
+        finally:
+            hub.unsubscribe(channel, queue)
+
+    tasks = [asyncio.create_task(subscriber()) for _ in range(subscribers)]
+    await asyncio.sleep(0.1)
+
+    publish_cost = []
+
+    def publisher():
+        for i in range(messages):
+            payload = batch_payload(i)
+            t0 = time.perf_counter()
+            sent_at[payload["movements"][0]["timestamp"]] = t0
+            hub.publish(channel, "movements", payload)
+            publish_cost.append(time.perf_counter() - t0)
+            if rate > 0:
+                time.sleep(1.0 / rate)
+
+    start = time.perf_counter()
+    thread = threading.Thread(target=publisher)
+    thread.start()
+    await asyncio.get_running_loop().run_in_executor(None, thread.join)
+    #let the loop finish the queued fanouts and drain every subscriber
+    await asyncio.sleep(0)
+    while any(not q.empty() for q in queues):
+        await asyncio.sleep(0.001)
+    elapsed = time.perf_counter() - start
+    for task in tasks:
+        task.cancel()
+
+    #time from publish until the slowest subscriber had the message
+    fanout = [last_seen[k] - sent_at[k] for k in sent_at if k in last_seen]
+    size = len(f"event: movements\ndata: {json.dumps(batch_payload(0))}\n\n")
+    print(f"{subscribers} subscribers, {messages} messages, {received[0]} deliveries in {elapsed:.2f} s ({received[0] / elapsed:,.0f}/s)")
+    print(f"publish call (ingest thread): p50 {percentile(publish_cost, 50) * 1e6:.0f} us, p99 {percentile(publish_cost, 99) * 1e6:.0f} us")
+    if fanout:
+        print(f"publish to last subscriber:   p50 {percentile(fanout, 50) * 1000:.1f} ms, p99 {percentile(fanout, 99) * 1000:.1f} ms")
+    print(f"resyncs (slow subscriber): {resyncs[0]}")
+
+    #what polling would move instead: a full refresh with the default fetch count
+    refresh = len(json.dumps({"movements": [{"timestamp": 1700000000 + j, "is_entry": True} for j in range(5000)]}))
+    print(f"push message {size} bytes vs full refresh {refresh:,} bytes per subscriber")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--subscribers", type=int, default=500)
+    parser.add_argument("--messages", type=int, default=200)
+    parser.add_argument("--rate", type=float, default=50, help="publishes per second, 0 = back to back")
+    args = parser.parse_args()
+    asyncio.run(run(args.subscribers, args.messages, args.rate))
@@ -0,0 +1,138 @@
+#storage and historical query benchmark for the raw sqlite tier vs the compacted archive
+#builds a synthetic year, measures queries, compacts, measures again and checks results match
+#usage: python dashboard/bench_retention.py [--devices 3] [--per-day 2000]
+import argparse
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+import uuid
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import archive
+import main
+
+
+def dir_size(path):
+    total = 0
+    for root, _, files in os.walk(path):
+        total += sum(os.path.getsize(os.path.join(root, f)) for f in files)
+    return total
+
+#file size as the server leaves it (no extra VACUUM here, compaction has to free the space itself)
+def db_size(path):
+    return os.path.getsize(path)
+
+def table_rows(path, tables):
+    conn = sqlite3.connect(path)
+    counts = {t: conn.execute(f"SELECT COUNT(*) FROM {t}").fetchone()[0] for t in tables}
+    conn.close()
+    return counts
+
+def timed(fn, repeat=3):
+    best = None
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        result = fn()
+        elapsed = time.perf_counter() - t0
+        best = elapsed if best is None else min(best, elapsed)
+    return result, best
+
+def queries(keys, store_key, year_start, year_end, per_day):
+    key = keys[0]
+    month_since = archive.month_start(year_start + 160 * 86400)
+    month_until = archive.next_month(month_since) - 1
+    deep = year_start + 240 * 86400
+
+    def hourly():
+        return main.get_hourly(year_start, year_end, key)
+    def packed():
+        return main.get_movements_packed(month_since, month_until, api_key=key)
+    def recent_count():
+        return main.get_movements(deep, 5000, key)
+    #store view of one archived day: every device of the store, both tiers
+    deep_day_end = deep - deep % 86400 + 86399
+    def store_day():
+        return main.get_store_movements(deep_day_end, per_day * len(keys), store_key)
+    def store_hours():
+        return main.get_store_stats(store_key, year_start, year_end)["hours"]
+
+    return [
+        ("hourly, full year", hourly),
+        ("packed range, one month", packed),
+        ("5000 newest before a date", recent_count),
+        ("store, one archived day", store_day),
+        ("store hours, full year", store_hours),
+    ]
+
+
+def main_bench():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=3)
+    parser.add_argument("--per-day", type=int, default=2000, help="events per device per day")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    year_start = archive.month_start(1700000000)
+    year_end = year_start + 365 * 86400 - 1
+    #compact as if it is the end of the year, so everything but the last 90 days moves
+    now = year_end
+
+    with tempfile.TemporaryDirectory() as tmp:
+        main.entrysDb = os.path.join(tmp, "entries.db")
+        main.archiveDir = os.path.join(tmp, "archive")
+        keys = [str(uuid.uuid4()) for _ in range(args.devices)]
+        main.write_movements([], keys[0])
+
+        conn = sqlite3.connect(main.entrysDb)
+        total = 0
+        for key in keys:
+            rows = []
+            for day in range(365):
+                day_start = year_start + day * 86400
+                #store open 8:00-21:00
+                for _ in range(args.per_day):
+                    rows.append((day_start + random.randint(8 * 3600, 21 * 3600), random.random() < 0.5, key))
+            rows.sort()
+            conn.executemany("INSERT INTO movements (timestamp, is_entry, apikey) VALUES (?, ?, ?)", rows)
+            total += len(rows)
+        conn.commit()
+        conn.close()
+        store_key = main.create_store("bench")
+        for key in keys:
+            main.assign_device(store_key, key, key[:8])
+        print(f"{args.devices} devices, {total:,} events over one year")
+
+        raw_size = db_size(main.entrysDb)
+        tables = ("movements", "hourly_rollups", "store_buckets")
+        raw_rows = table_rows(main.entrysDb, tables)
+        before = {}
+        for name, fn in queries(keys, store_key, year_start, year_end, args.per_day):
+            before[name] = timed(fn)
+
+        t0 = time.perf_counter()
+        result = main.compact_movements(now=now)
+        compact_time = time.perf_counter() - t0
+
+        tiered_db = db_size(main.entrysDb)
+        archive_size = dir_size(main.archiveDir)
+        print(f"compaction: {result['moved']:,} rows from {result['months']} device months in {compact_time:.1f} s")
+        print(f"raw sqlite:       {raw_size / 1e6:8.1f} MB")
+        print(f"tiered: sqlite    {tiered_db / 1e6:8.1f} MB + archive {archive_size / 1e6:.1f} MB = {(tiered_db + archive_size) / 1e6:.1f} MB ({raw_size / (tiered_db + archive_size):.1f}x smaller)")
+        print(f"archive: {archive_size * 8 / result['moved']:.2f} bits per event")
+        tiered_rows = table_rows(main.entrysDb, tables)
+        for t in tables:
+            print(f"{t + ' rows':22} {raw_rows[t]:>10,} -> {tiered_rows[t]:,}")
+
+        print(f"{'query':30} {'raw ms':>9} {'tiered ms':>10}  same result")
+        for name, fn in queries(keys, store_key, year_start, year_end, args.per_day):
+            after = timed(fn)
+            same = after[0] == before[name][0]
+            print(f"{name:30} {before[name][1] * 1000:9.1f} {after[1] * 1000:10.1f}  {same}")
+
+
+if __name__ == "__main__":
+    main_bench()
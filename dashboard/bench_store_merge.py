@@ -0,0 +1,121 @@
+#synthetic benchmark of the store merge done at ingest
+#simulates devices posting batches like report_task does (every 10s, up to 20 events)
+#usage: python dashboard/bench_store_merge.py [--devices 50] [--days 7] [--per-day 300]
+import argparse
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import main
+
+
+def make_batches(devices, days, per_day, start):
+    #one list of (post_time, api_key, [Movement]) ordered by post time
+    batches = []
+    for key in devices:
+        t = start
+        end = start + days * 86400
+        gap = 86400 / per_day
+        pending = []
+        next_post = t + 10
+        while t < end:
+            t += int(random.expovariate(1.0 / gap)) + 1
+            #post what is queued every report period
+            while t >= next_post:
+                if pending:
+                    batches.append((next_post, key, pending[:20]))
+                    pending = pending[20:]
+                next_post += 10
+            pending.append(main.Movement(time=t, form=random.random() < 0.5))
+        if pending:
+            batches.append((next_post, key, pending))
+    batches.sort(key=lambda b: b[0])
+    return batches
+
+
+def run(db_path, batches, grouped, store_key):
+    main.entrysDb = db_path
+    if grouped:
+        for key in sorted({b[1] for b in batches}):
+            main.assign_device(store_key, key, key[:8])
+
+    conn = sqlite3.connect(db_path)
+    #measure sql work, not disk flushes
+    conn.execute("PRAGMA synchronous = OFF")
+    cursor = conn.cursor()
+    merge_time = 0.0
+    start = time.perf_counter()
+    for post_time, key, movements in batches:
+        for m in movements:
+            cursor.execute(
+                "INSERT INTO movements (timestamp, is_entry, apikey) VALUES (?, ?, ?)",
+                (m.time, 1 if m.form else 0, key)
+            )
+        if grouped:
+            t0 = time.perf_counter()
+            main.merge_store_movements(cursor, movements, key, now=post_time)
+            merge_time += time.perf_counter() - t0
+        conn.commit()
+    total = time.perf_counter() - start
+    conn.close()
+    return total, merge_time
+
+
+def main_bench():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=50)
+    parser.add_argument("--days", type=int, default=7)
+    parser.add_argument("--per-day", type=int, default=300, help="events per device per day")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    start = 1700000000 - 1700000000 % 86400
+    devices = [f"device-{i:03d}" for i in range(args.devices)]
+    batches = make_batches(devices, args.days, args.per_day, start)
+    events = sum(len(b[2]) for b in batches)
+    print(f"{args.devices} devices, {args.days} days, {events} events in {len(batches)} batches")
+
+    with tempfile.TemporaryDirectory() as tmp:
+        results = {}
+        for grouped in (False, True):
+            db_path = os.path.join(tmp, f"entries_{int(grouped)}.db")
+            main.entrysDb = db_path
+            #create schema through the normal ingest path
+            main.write_movements([], "setup")
+            store_key = main.create_store("bench") if grouped else None
+            total, merge_time = run(db_path, batches, grouped, store_key)
+            results[grouped] = (total, merge_time, store_key, db_path)
+
+        plain, _, _, _ = results[False]
+        total, merge_time, store_key, db_path = results[True]
+        print(f"ingest without store:  {plain:8.2f} s  ({plain / len(batches) * 1e6:7.1f} us/batch)")
+        print(f"ingest with store:     {total:8.2f} s  ({total / len(batches) * 1e6:7.1f} us/batch)")
+        print(f"merge alone:           {merge_time:8.2f} s  ({merge_time / len(batches) * 1e6:7.1f} us/batch, {merge_time / events * 1e6:.1f} us/event)")
+
+        main.entrysDb = db_path
+        t0 = time.perf_counter()
+        stats = main.get_store_stats(store_key, start, start + args.days * 86400)
+        week_query = time.perf_counter() - t0
+        print(f"store stats for {len(stats['hours'])} hours: {week_query * 1000:.1f} ms, occupancy {stats['occupancy']}")
+
+        #reference: what a per request merge would cost, scanning all raw rows
+        conn = sqlite3.connect(db_path)
+        t0 = time.perf_counter()
+        conn.execute(
+            """
+                SELECT "timestamp" - "timestamp" % 3600 AS hour, SUM(is_entry), SUM(1 - is_entry)
+                FROM movements WHERE apikey IN (SELECT apikey FROM devices) GROUP BY hour
+            """
+        ).fetchall()
+        raw_query = time.perf_counter() - t0
+        conn.close()
+        print(f"same hours from raw rows: {raw_query * 1000:.1f} ms")
+
+
+if __name__ == "__main__":
+    main_bench()
@@ -1,24 +1,434 @@
+import archive
+import asyncio
+import calendar
 import fastapi
+import heapq
+import json
+import os
 import sqlite3
+import struct
+import sys
+import time
+from array import array
 import uuid
 import uvicorn
 from pydantic import BaseModel
 from typing import List
-from fastapi.responses import FileResponse
+from fastapi.responses import FileResponse, Response, StreamingResponse
 
 usersDb = "dashboard/users.db"
 entrysDb = "dashboard/entries.db"
 APIkeys = {}
+storeBucketSeconds = 60  #merge window for store level counts
+deviceIdleSeconds = 15 * 60  #silent devices stop holding back the store merge
 app = fastapi.FastAPI()
 app.title = "Dashboard API"
+liveQueueSize = 64  #messages buffered per live subscriber before it is told to resync
+liveKeepaliveSeconds = 15
+archiveDir = "dashboard/archive"
+rawRetentionDays = 90  #whole months older than this move from sqlite to the archive
+compactIntervalSeconds = 24 * 3600
+flowDirections = 8  #E, NE, N, NW, W, SW, S, SE as sent by the device
+flowMaxCells = 4096
 
 class Movement(BaseModel):
     time: int  # Unix timestamp
     form: bool  #Boolean true = in, false = out
 
+#heatmap/direction snapshot from a device, cells are [index, occupancy_ms, 8 direction counts]
+class FlowSnapshot(BaseModel):
+    start: int
+    end: int
+    cols: int
+    rows: int
+    cells: List[List[int]]
+
+
+#fan out of ingest updates to dashboards listening on /live/
+#channels are "device:<api_key>" and "store:<store_key>", each message is
+#formatted once and the same string is queued to every subscriber
+class LiveHub:
+    def __init__(self, queue_size):
+        self.loop = None
+        self.queue_size = queue_size
+        self.channels = {}
+
+    def has_subscribers(self, channel):
+        return bool(self.channels.get(channel))
+
+    #subscribe/unsubscribe run on the event loop
+    def subscribe(self, channel):
+        queue = asyncio.Queue(maxsize=self.queue_size)
+        self.channels.setdefault(channel, set()).add(queue)
+        return queue
+
+    def unsubscribe(self, channel, queue):
+        subscribers = self.channels.get(channel)
+        if subscribers is not None:
+            subscribers.discard(queue)
+            if not subscribers:
+                del self.channels[channel]
+
+    #safe to call from the threadpool the ingest handlers run in
+    def publish(self, channel, event, data):
+        if self.loop is None or not self.has_subscribers(channel):
+            return
+        message = f"event: {event}\ndata: {json.dumps(data)}\n\n"
+        self.loop.call_soon_threadsafe(self.fanout, channel, message)
+
+    def fanout(self, channel, message):
+        for queue in list(self.channels.get(channel, ())):
+            try:
+                queue.put_nowait(message)
+            except asyncio.QueueFull:
+                #subscriber fell behind, drop its backlog and let it refetch
+                while not queue.empty():
+                    queue.get_nowait()
+                queue.put_nowait("event: resync\ndata: {}\n\n")
+
+liveHub = LiveHub(liveQueueSize)
+
 
 #db funcs
 
+#store/device grouping tables, kept next to movements so they can be joined
+def create_store_tables(cursor):
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS stores (
+        id INTEGER PRIMARY KEY,
+        name TEXT,
+        store_key TEXT UNIQUE,
+        occupancy INTEGER DEFAULT 0,
+        merged_until INTEGER DEFAULT 0
+    )
+    ''')
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS devices (
+        apikey TEXT PRIMARY KEY,
+        store_id INTEGER,
+        name TEXT,
+        last_ts INTEGER DEFAULT 0,
+        last_seen INTEGER DEFAULT 0
+    )
+    ''')
+    cursor.execute("CREATE INDEX IF NOT EXISTS idx_devices_store ON devices (store_id)")
+    #per store entries/exits merged across devices in fixed windows
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS store_buckets (
+        store_id INTEGER,
+        bucket INTEGER,
+        entries INTEGER DEFAULT 0,
+        exits INTEGER DEFAULT 0,
+        PRIMARY KEY (store_id, bucket)
+    )
+    ''')
+
+#merge a device batch into its store, runs inside the ingest transaction
+#buckets are plain counters so arrival order does not matter for them, occupancy
+#is only advanced up to the watermark (oldest last event of the active devices)
+#so a device reporting late still lands in order
+def merge_store_movements(cursor, movements, api_key, now=None):
+    cursor.execute("SELECT store_id, last_ts FROM devices WHERE apikey = ?", (api_key,))
+    row = cursor.fetchone()
+    if row is None or row[0] is None or not movements:
+        return None
+    store_id, last_ts = row
+    now = int(time.time()) if now is None else now
+
+    #collapse the batch into bucket deltas first
+    deltas = {}
+    for movement in movements:
+        bucket = movement.time - movement.time % storeBucketSeconds
+        d = deltas.setdefault(bucket, [0, 0])
+        d[0 if movement.form else 1] += 1
+        last_ts = max(last_ts, movement.time)
+
+    cursor.executemany(
+        """
+            INSERT INTO store_buckets (store_id, bucket, entries, exits) VALUES (?, ?, ?, ?)
+            ON CONFLICT(store_id, bucket) DO UPDATE SET
+                entries = entries + excluded.entries,
+                exits = exits + excluded.exits;
+        """,
+        [(store_id, b, d[0], d[1]) for b, d in deltas.items()]
+    )
+    cursor.execute(
+        "UPDATE devices SET last_ts = ?, last_seen = ? WHERE apikey = ?",
+        (last_ts, now, api_key)
+    )
+
+    cursor.execute("SELECT occupancy, merged_until FROM stores WHERE id = ?", (store_id,))
+    occupancy, merged_until = cursor.fetchone()
+
+    #late events behind the merged point are applied straight away
+    for bucket, d in sorted(deltas.items()):
+        if bucket < merged_until:
+            occupancy = max(0, occupancy + d[0] - d[1])
+
+    #watermark over devices still reporting, all idle means nothing to wait for
+    cursor.execute(
+        "SELECT MIN(last_ts), MAX(last_ts) FROM devices WHERE store_id = ? AND last_seen >= ?",
+        (store_id, now - deviceIdleSeconds)
+    )
+    low, high = cursor.fetchone()
+    watermark = low if low is not None else last_ts
+    watermark -= watermark % storeBucketSeconds
+
+    #walk newly closed windows in time order
+    if watermark > merged_until:
+        cursor.execute(
+            """
+                SELECT entries, exits FROM store_buckets
+                WHERE store_id = ? AND bucket >= ? AND bucket < ?
+                ORDER BY bucket ASC;
+            """,
+            (store_id, merged_until, watermark)
+        )
+        for entries, exits in cursor.fetchall():
+            occupancy = max(0, occupancy + entries - exits)
+        merged_until = watermark
+
+    cursor.execute(
+        "UPDATE stores SET occupancy = ?, merged_until = ? WHERE id = ?",
+        (occupancy, merged_until, store_id)
+    )
+    return store_id
+
+#store buckets older than until become one row per hour (months that went to the archive
+#only need hours), minute rows are summed into the hour row, which may already exist
+def roll_up_store_buckets(cursor, until):
+    cursor.execute(
+        """
+            INSERT INTO store_buckets (store_id, bucket, entries, exits)
+            SELECT store_id, bucket - bucket % 3600, SUM(entries), SUM(exits)
+            FROM store_buckets
+            WHERE bucket < ? AND bucket % 3600 != 0
+            GROUP BY store_id, bucket - bucket % 3600
+            ON CONFLICT(store_id, bucket) DO UPDATE SET
+                entries = entries + excluded.entries,
+                exits = exits + excluded.exits;
+        """,
+        (until,)
+    )
+    cursor.execute("DELETE FROM store_buckets WHERE bucket < ? AND bucket % 3600 != 0", (until,))
+    cursor.execute("DELETE FROM store_buckets WHERE bucket < ? AND entries = 0 AND exits = 0", (until,))
+
+#archive index and hourly rollups of archived months
+def create_archive_tables(cursor):
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS archive_months (
+        apikey TEXT,
+        month INTEGER,
+        month_end INTEGER,
+        path TEXT,
+        count INTEGER,
+        PRIMARY KEY (apikey, month)
+    )
+    ''')
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS hourly_rollups (
+        apikey TEXT,
+        hour INTEGER,
+        entries INTEGER,
+        exits INTEGER,
+        PRIMARY KEY (apikey, hour)
+    )
+    ''')
+
+#archived (timestamp, is_entry) rows of a device between since and until inclusive, ascending
+def archived_rows(cursor, api_key, since, until):
+    cursor.execute(
+        "SELECT path FROM archive_months WHERE apikey = ? AND month <= ? AND month_end > ? ORDER BY month ASC",
+        (api_key, until, since)
+    )
+    rows = []
+    for (path,) in cursor.fetchall():
+        rows.extend(r for r in archive.read_month(path) if since <= r[0] <= until)
+    return rows
+
+#both tiers of one device between since and until inclusive, ascending
+def device_rows(cursor, api_key, since, until):
+    cursor.execute(
+        """
+            SELECT "timestamp", is_entry
+            FROM movements
+            WHERE apikey = ? AND "timestamp" >= ? AND "timestamp" <= ?
+            ORDER BY "timestamp" ASC;
+        """,
+        (api_key, since, until)
+    )
+    raw = cursor.fetchall()
+    return list(heapq.merge(archived_rows(cursor, api_key, since, until), raw))
+
+#start of the oldest month still kept raw
+def retention_cutoff(now=None):
+    now = int(time.time()) if now is None else now
+    return archive.month_start(now - rawRetentionDays * 86400)
+
+#deleted rows only shrink the file with auto_vacuum on, switching an existing database
+#over takes one full VACUUM (done once, by the first compaction after an upgrade)
+def enable_incremental_vacuum(conn):
+    if conn.execute("PRAGMA auto_vacuum").fetchone()[0] != 2:
+        conn.execute("PRAGMA auto_vacuum = INCREMENTAL")
+        conn.commit()
+        conn.execute("VACUUM")
+
+#move whole months older than the retention window into the archive
+#the new file is written first and the db switch (index, rollups, raw delete) is one
+#transaction, so a crash leaves either the old state or the new one plus a stray file
+#only the rows read into the file are deleted, rows posted meanwhile wait for the next run
+def compact_movements(now=None):
+    cutoff = retention_cutoff(now)
+
+    conn = sqlite3.connect(entrysDb)
+    enable_incremental_vacuum(conn)
+    cursor = conn.cursor()
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS movements (
+        id INTEGER PRIMARY KEY,
+        timestamp INTEGER,
+        is_entry INTEGER,
+        apikey TEXT
+    )
+    ''')
+    create_archive_tables(cursor)
+
+    cursor.execute(
+        """
+            SELECT DISTINCT apikey, strftime('%Y-%m', "timestamp", 'unixepoch') AS month
+            FROM movements
+            WHERE "timestamp" < ?
+            ORDER BY apikey, month;
+        """,
+        (cutoff,)
+    )
+    months = cursor.fetchall()
+    moved = 0
+    for api_key, month_str in months:
+        month = calendar.timegm(time.strptime(month_str, "%Y-%m"))
+        month_end = archive.next_month(month)
+
+        cursor.execute(
+            """
+                SELECT id, "timestamp", is_entry FROM movements
+                WHERE apikey = ? AND "timestamp" >= ? AND "timestamp" < ?
+                ORDER BY "timestamp" ASC;
+            """,
+            (api_key, month, month_end)
+        )
+        selected = cursor.fetchall()
+        raw = [(ts, is_entry) for _, ts, is_entry in selected]
+
+        #late rows for a month archived before are folded into a rewritten file
+        cursor.execute("SELECT path FROM archive_months WHERE apikey = ? AND month = ?", (api_key, month))
+        old = cursor.fetchone()
+        rows = list(heapq.merge(archive.read_month(old[0]), raw)) if old else raw
+        path = archive.write_month(archiveDir, api_key, month, rows)
+
+        rollups = {}
+        for ts, is_entry in rows:
+            r = rollups.setdefault(ts - ts % 3600, [0, 0])
+            r[0 if is_entry else 1] += 1
+
+        cursor.execute(
+            "DELETE FROM hourly_rollups WHERE apikey = ? AND hour >= ? AND hour < ?",
+            (api_key, month, month_end)
+        )
+        cursor.executemany(
+            "INSERT INTO hourly_rollups (apikey, hour, entries, exits) VALUES (?, ?, ?, ?)",
+            [(api_key, hour, r[0], r[1]) for hour, r in rollups.items()]
+        )
+        cursor.execute(
+            "INSERT OR REPLACE INTO archive_months (apikey, month, month_end, path, count) VALUES (?, ?, ?, ?, ?)",
+            (api_key, month, month_end, path, len(rows))
+        )
+        cursor.executemany("DELETE FROM movements WHERE id = ?", [(row_id,) for row_id, _, _ in selected])
+        conn.commit()
+        moved += len(raw)
+
+        if old and old[0] != path:
+            try:
+                os.remove(old[0])
+            except OSError:
+                pass
+
+    #store buckets of the archived months down to hours, in the same pass
+    create_store_tables(cursor)
+    roll_up_store_buckets(cursor, cutoff)
+    conn.commit()
+
+    #give the pages freed by the deletes back to the file system
+    #(through executescript, cursor.execute stops it after the first page)
+    conn.executescript("PRAGMA incremental_vacuum;")
+    conn.close()
+    return {"months": len(months), "moved": moved}
+
+#hourly entries/exits for the hours touched by a batch, sent along with live updates
+def touched_hours(movements):
+    hours = [m.time - m.time % 3600 for m in movements]
+    return min(hours), max(hours) + 3600
+
+#raw rows plus rollups of archived months
+def device_hours(cursor, api_key, since, until):
+    create_archive_tables(cursor)
+    cursor.execute(
+        """
+            SELECT hour, SUM(entries), SUM(exits) FROM (
+                SELECT "timestamp" - "timestamp" % 3600 AS hour, is_entry AS entries, 1 - is_entry AS exits
+                FROM movements
+                WHERE apikey = ? AND "timestamp" >= ? AND "timestamp" < ?
+                UNION ALL
+                SELECT hour, entries, exits
+                FROM hourly_rollups
+                WHERE apikey = ? AND hour >= ? AND hour < ?
+            )
+            GROUP BY hour
+            ORDER BY hour ASC;
+        """,
+        (api_key, since, until, api_key, since, until)
+    )
+    return [{"hour": r[0], "entries": r[1], "exits": r[2]} for r in cursor.fetchall()]
+
+def store_hours(cursor, store_id, since, until):
+    cursor.execute(
+        """
+            SELECT bucket - bucket % 3600 AS hour, SUM(entries), SUM(exits)
+            FROM store_buckets
+            WHERE store_id = ? AND bucket >= ? AND bucket < ?
+            GROUP BY hour
+            ORDER BY hour ASC;
+        """,
+        (store_id, since, until)
+    )
+    return [{"hour": r[0], "entries": r[1], "exits": r[2]} for r in cursor.fetchall()]
+
+#push committed movements to live subscribers of the device and its store
+def publish_movements(cursor, movements, api_key, store_id):
+    if not movements:
+        return
+    events = [{"timestamp": m.time, "is_entry": bool(m.form)} for m in movements]
+    since, until = touched_hours(movements)
+
+    channel = "device:" + api_key
+    if liveHub.has_subscribers(channel):
+        liveHub.publish(channel, "movements", {
+            "movements": events,
+            "hours": device_hours(cursor, api_key, since, until),
+        })
+
+    if store_id is None:
+        return
+    cursor.execute("SELECT store_key, occupancy, merged_until FROM stores WHERE id = ?", (store_id,))
+    store_key, occupancy, merged_until = cursor.fetchone()
+    channel = "store:" + store_key
+    if liveHub.has_subscribers(channel):
+        liveHub.publish(channel, "movements", {
+            "movements": events,
+            "hours": store_hours(cursor, store_id, since, until),
+            "occupancy": occupancy,
+            "merged_until": merged_until,
+        })
+
 #write movements to db, with unix time and whether in or out
 def write_movements(movements, api_key):
         conn = sqlite3.connect(entrysDb)
@@ -34,16 +444,101 @@ def write_movements(movements, api_key):
         )
         ''')
         
+        cursor.execute(
+            "CREATE INDEX IF NOT EXISTS idx_movements_apikey_ts ON movements (apikey, \"timestamp\")"
+        )
+        create_store_tables(cursor)
+        
         # Insert movements into the database
         for movement in movements:
             cursor.execute(
                 "INSERT INTO movements (timestamp, is_entry, apikey) VALUES (?, ?, ?)",
                 (movement.time, 1 if movement.form else 0, api_key)
             )
+
+        #keep store aggregates current in the same transaction
+        store_id = merge_store_movements(cursor, movements, api_key)
         
         # Commit changes and close connection
         conn.commit()
+        #only committed data goes out to live dashboards
+        publish_movements(cursor, movements, api_key, store_id)
+        conn.close()
+
+#heatmap/direction grid per device, snapshots are summed into hour buckets
+#(hour of the snapshot start), one row per cell so a range is one GROUP BY
+def create_flow_tables(cursor):
+    directions = ", ".join(f"d{i} INTEGER NOT NULL DEFAULT 0" for i in range(flowDirections))
+    cursor.execute(f'''
+    CREATE TABLE IF NOT EXISTS flow_cells (
+        apikey TEXT,
+        hour INTEGER,
+        cols INTEGER,
+        rows INTEGER,
+        cell INTEGER,
+        occupancy_ms INTEGER NOT NULL DEFAULT 0,
+        {directions},
+        PRIMARY KEY (apikey, hour, cols, rows, cell)
+    )
+    ''')
+
+def write_flow(snapshot, api_key):
+    cells = snapshot.cols * snapshot.rows
+    if snapshot.cols <= 0 or snapshot.rows <= 0 or cells > flowMaxCells:
+        raise ValueError("bad grid size")
+    rows = []
+    hour = snapshot.start - snapshot.start % 3600
+    for cell in snapshot.cells:
+        if len(cell) != 2 + flowDirections or not 0 <= cell[0] < cells:
+            raise ValueError("bad cell")
+        rows.append((api_key, hour, snapshot.cols, snapshot.rows, *cell))
+
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_flow_tables(cursor)
+    directions = [f"d{i}" for i in range(flowDirections)]
+    cursor.executemany(
+        f"INSERT INTO flow_cells (apikey, hour, cols, rows, cell, occupancy_ms, {', '.join(directions)}) "
+        f"VALUES ({', '.join('?' * (6 + flowDirections))}) "
+        f"ON CONFLICT (apikey, hour, cols, rows, cell) DO UPDATE SET occupancy_ms = occupancy_ms + excluded.occupancy_ms, "
+        + ", ".join(f"{d} = {d} + excluded.{d}" for d in directions),
+        rows
+    )
+    conn.commit()
+    conn.close()
+    return len(rows)
+
+#summed grid for hours starting in [since, until], grid size of the newest snapshot
+def get_flow(since, until, api_key):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_flow_tables(cursor)
+    since -= since % 3600
+    cursor.execute(
+        "SELECT cols, rows FROM flow_cells WHERE apikey = ? AND hour BETWEEN ? AND ? ORDER BY hour DESC LIMIT 1",
+        (api_key, since, until)
+    )
+    grid = cursor.fetchone()
+    if grid is None:
         conn.close()
+        return {"cols": 0, "rows": 0, "occupancy_s": [], "directions": []}
+    cols, rows = grid
+
+    directions = [f"SUM(d{i})" for i in range(flowDirections)]
+    cursor.execute(
+        f"SELECT cell, SUM(occupancy_ms), {', '.join(directions)} FROM flow_cells "
+        "WHERE apikey = ? AND hour BETWEEN ? AND ? AND cols = ? AND rows = ? GROUP BY cell",
+        (api_key, since, until, cols, rows)
+    )
+    occupancy = [0.0] * (cols * rows)
+    counts = [0] * (cols * rows * flowDirections)
+    for row in cursor.fetchall():
+        cell = row[0]
+        occupancy[cell] = row[1] / 1000
+        counts[cell * flowDirections:(cell + 1) * flowDirections] = row[2:]
+    conn.close()
+    #flat lists: occupancy_s[cell], directions[cell * 8 + direction]
+    return {"cols": cols, "rows": rows, "occupancy_s": occupancy, "directions": counts}
 
 #create api key and add to users db
 def create_apikey():
@@ -111,6 +606,14 @@ def get_movements(since, count, api_key):
     )
     ''')
     
+    create_archive_tables(cursor)
+    
+    rows = newest_rows(cursor, api_key, since, count)
+    conn.close()
+    return [{"timestamp": row[0], "is_entry": bool(row[1])} for row in rows]
+
+#up to count newest rows of one device at or before since across both tiers, newest first
+def newest_rows(cursor, api_key, since, count):
     cursor.execute(
         """
             SELECT "timestamp", is_entry
@@ -122,6 +625,241 @@ def get_movements(since, count, api_key):
         (since, api_key, count)
     )
     rows = cursor.fetchall()
+
+    #walk archived months backwards until they alone could fill the request
+    cursor.execute(
+        "SELECT path FROM archive_months WHERE apikey = ? AND month <= ? ORDER BY month DESC",
+        (api_key, since)
+    )
+    archived = []
+    for (path,) in cursor.fetchall():
+        if len(archived) >= count:
+            break
+        month_rows = [r for r in archive.read_month(path) if r[0] <= since]
+        archived.extend(reversed(month_rows))
+
+    if archived:
+        rows = heapq.nlargest(count, rows + archived, key=lambda r: r[0])
+    return rows
+
+#hourly entries/exits of a device across both tiers, cheap for long ranges
+def get_hourly(since, until, api_key):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS movements (
+        id INTEGER PRIMARY KEY,
+        timestamp INTEGER,
+        is_entry INTEGER,
+        apikey TEXT
+    )
+    ''')
+    hours = device_hours(cursor, api_key, since, until + 1)
+    conn.close()
+    return hours
+
+#create a store, returns key used to read the merged view
+def create_store(name):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+
+    store_key = str(uuid.uuid4())
+    cursor.execute(
+        "INSERT INTO stores (name, store_key) VALUES (?, ?)",
+        (name, store_key)
+    )
+    conn.commit()
+    conn.close()
+    return store_key
+
+#attach a device to a store, history already recorded is folded into the buckets
+#(archived months per hour, as compaction left them in the store, raw rows per minute)
+#a device moving between stores takes its history along, so a store's buckets always
+#add up to the events of its current devices (the old store's occupancy is left as is)
+def assign_device(store_key, api_key, name):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+
+    cursor.execute("SELECT id FROM stores WHERE store_key = ?", (store_key,))
+    row = cursor.fetchone()
+    if row is None:
+        conn.close()
+        return False
+    store_id = row[0]
+
+    cursor.execute("SELECT store_id FROM devices WHERE apikey = ?", (api_key,))
+    current = cursor.fetchone()
+    if current is not None and current[0] == store_id:
+        cursor.execute("UPDATE devices SET name = ? WHERE apikey = ?", (name, api_key))
+        conn.commit()
+        conn.close()
+        return True
+
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS movements (
+        id INTEGER PRIMARY KEY,
+        timestamp INTEGER,
+        is_entry INTEGER,
+        apikey TEXT
+    )
+    ''')
+    cursor.execute(
+        """
+            SELECT "timestamp" - "timestamp" % ?, SUM(is_entry), SUM(1 - is_entry), MAX("timestamp")
+            FROM movements WHERE apikey = ?
+            GROUP BY 1;
+        """,
+        (storeBucketSeconds, api_key)
+    )
+    buckets = {}
+    last_ts = 0
+    for bucket, entries, exits, newest in cursor.fetchall():
+        buckets[bucket] = [entries, exits]
+        last_ts = max(last_ts, newest)
+
+    #months already moved to the archive
+    create_archive_tables(cursor)
+    for ts, is_entry in archived_rows(cursor, api_key, 0, 2**31 - 1):
+        b = buckets.setdefault(ts - ts % 3600, [0, 0])
+        b[0 if is_entry else 1] += 1
+        last_ts = max(last_ts, ts)
+
+    merge = """
+            INSERT INTO store_buckets (store_id, bucket, entries, exits) VALUES (?, ?, ?, ?)
+            ON CONFLICT(store_id, bucket) DO UPDATE SET
+                entries = entries + excluded.entries,
+                exits = exits + excluded.exits;
+        """
+    if current is not None and current[0] is not None:
+        cursor.executemany(merge, [(current[0], bucket, -b[0], -b[1]) for bucket, b in buckets.items()])
+        cursor.execute(
+            "DELETE FROM store_buckets WHERE store_id = ? AND entries = 0 AND exits = 0",
+            (current[0],)
+        )
+    cursor.executemany(merge, [(store_id, bucket, b[0], b[1]) for bucket, b in buckets.items()])
+    cursor.execute(
+        """
+            INSERT INTO devices (apikey, store_id, name, last_ts, last_seen) VALUES (?, ?, ?, ?, 0)
+            ON CONFLICT(apikey) DO UPDATE SET store_id = excluded.store_id, name = excluded.name, last_ts = excluded.last_ts;
+        """,
+        (api_key, store_id, name, last_ts)
+    )
+    conn.commit()
+    conn.close()
+    return True
+
+#merged store view: current occupancy plus hourly entries/exits between since and until
+def get_store_stats(store_key, since, until):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+
+    cursor.execute(
+        "SELECT id, name, occupancy, merged_until FROM stores WHERE store_key = ?",
+        (store_key,)
+    )
+    row = cursor.fetchone()
+    if row is None:
+        conn.close()
+        return None
+    store_id, name, occupancy, merged_until = row
+
+    cursor.execute(
+        "SELECT apikey, name, last_ts, last_seen FROM devices WHERE store_id = ? ORDER BY name",
+        (store_id,)
+    )
+    #device keys can post movements, a store key only gets to see their hash
+    devices = [
+        {"device_id": archive.device_id(r[0]), "name": r[1], "last_event": r[2], "last_seen": r[3]}
+        for r in cursor.fetchall()
+    ]
+
+    hours = store_hours(cursor, store_id, since, until + 1)
+    conn.close()
+    return {
+        "store": name,
+        "occupancy": occupancy,
+        "merged_until": merged_until,
+        "devices": devices,
+        "hours": hours,
+    }
+
+#events between since and until (inclusive) packed for the dashboard worker:
+#uint32 count, count x int32 timestamps ascending, then one bit per event (1 = entry)
+def pack_movements(rows):
+    timestamps = array("i", (row[0] for row in rows))
+    if sys.byteorder == "big":
+        timestamps.byteswap()
+    bits = bytearray((len(rows) + 7) // 8)
+    for i, row in enumerate(rows):
+        if row[1]:
+            bits[i >> 3] |= 1 << (i & 7)
+    return struct.pack("<I", len(rows)) + timestamps.tobytes() + bytes(bits)
+
+def get_movements_packed(since, until, api_key=None, store_key=None):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS movements (
+        id INTEGER PRIMARY KEY,
+        timestamp INTEGER,
+        is_entry INTEGER,
+        apikey TEXT
+    )
+    ''')
+
+    create_archive_tables(cursor)
+
+    if store_key is not None:
+        cursor.execute(
+            "SELECT d.apikey FROM devices d JOIN stores s ON s.id = d.store_id WHERE s.store_key = ?",
+            (store_key,)
+        )
+        keys = [row[0] for row in cursor.fetchall()]
+    else:
+        keys = [api_key]
+    #raw and archived rows of every device, merged in time order
+    rows = list(heapq.merge(*(device_rows(cursor, key, since, until) for key in keys)))
+    conn.close()
+    return pack_movements(rows)
+
+def store_exists(store_key):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+    cursor.execute("SELECT 1 FROM stores WHERE store_key = ?", (store_key,))
+    found = cursor.fetchone() is not None
+    conn.close()
+    return found
+
+#events of every device in the store (raw and archived), newest first like get_movements
+def get_store_movements(since, count, store_key):
+    conn = sqlite3.connect(entrysDb)
+    cursor = conn.cursor()
+    create_store_tables(cursor)
+    cursor.execute('''
+    CREATE TABLE IF NOT EXISTS movements (
+        id INTEGER PRIMARY KEY,
+        timestamp INTEGER,
+        is_entry INTEGER,
+        apikey TEXT
+    )
+    ''')
+
+    create_archive_tables(cursor)
+
+    cursor.execute(
+        "SELECT d.apikey FROM devices d JOIN stores s ON s.id = d.store_id WHERE s.store_key = ?",
+        (store_key,)
+    )
+    keys = [row[0] for row in cursor.fetchall()]
+    rows = []
+    for key in keys:
+        rows.extend(newest_rows(cursor, key, since, count))
+    rows = heapq.nlargest(count, rows, key=lambda r: r[0])
     conn.close()
     return [{"timestamp": row[0], "is_entry": bool(row[1])} for row in rows]
             
@@ -175,6 +913,117 @@ def create_movements(movements: List[Movement], api_key: str):
         )
 
 
+#periodic heatmap/direction snapshot from a device
+@app.post("/flow/")
+def create_flow(snapshot: FlowSnapshot, api_key: str):
+    if api_key not in APIkeys:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+    try:
+        count = write_flow(snapshot, api_key)
+    except ValueError as e:
+        raise fastapi.HTTPException(status_code=400, detail=str(e))
+    return {"message": f"{count} cells recorded"}
+
+
+@app.get("/getFlow/")
+def read_flow(since: int, until: int, api_key: str):
+    if api_key not in APIkeys:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+    return get_flow(since, until, api_key)
+
+
+#api request to create a store for grouping devices
+@app.post("/createStore/")
+def api_create_store(name: str):
+    store_key = create_store(name)
+    return {"store_key": store_key}
+
+
+#api request to put a device (api key) into a store
+@app.post("/assignDevice/")
+def api_assign_device(store_key: str, api_key: str, name: str = ""):
+    if api_key not in APIkeys:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+    if not assign_device(store_key, api_key, name or api_key[:8]):
+        raise fastapi.HTTPException(status_code=404, detail="Unknown store key")
+    return {"message": "device assigned"}
+
+
+@app.get("/getStoreStats/")
+def read_store_stats(store_key: str, since: int, until: int):
+    stats = get_store_stats(store_key, since, until)
+    if stats is None:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid store key")
+    return stats
+
+
+@app.get("/getStoreMovements/")
+def read_store_movements(date: int, count: int, store_key: str):
+    try:
+        movements = get_store_movements(date, count, store_key)
+        return {"movements": movements}
+    except Exception as e:
+        print(f"Error retrieving store movements: {str(e)}")
+        raise fastapi.HTTPException(
+            status_code=500,
+            detail=f"Failed to retrieve movements: {str(e)}"
+        )
+
+
+@app.get("/getHourly/")
+def read_hourly(since: int, until: int, api_key: str):
+    if api_key not in APIkeys:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+    return {"hours": get_hourly(since, until, api_key)}
+
+
+#binary range fetch for multi-day dashboard views
+@app.get("/getMovementsPacked/")
+def read_movements_packed(since: int, until: int, api_key: str = "", store_key: str = ""):
+    if store_key:
+        if not store_exists(store_key):
+            raise fastapi.HTTPException(status_code=401, detail="Invalid store key")
+        body = get_movements_packed(since, until, store_key=store_key)
+    elif api_key in APIkeys:
+        body = get_movements_packed(since, until, api_key=api_key)
+    else:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+    return Response(content=body, media_type="application/octet-stream")
+
+
+#server-sent events: new movements and hourly totals as ingest commits them
+@app.get("/live/")
+async def live_movements(request: fastapi.Request, api_key: str = "", store_key: str = ""):
+    if store_key:
+        if not store_exists(store_key):
+            raise fastapi.HTTPException(status_code=401, detail="Invalid store key")
+        channel = "store:" + store_key
+    elif api_key in APIkeys:
+        channel = "device:" + api_key
+    else:
+        raise fastapi.HTTPException(status_code=401, detail="Invalid API key")
+
+    queue = liveHub.subscribe(channel)
+
+    async def stream():
+        try:
+            yield "retry: 3000\n\n"
+            while not await request.is_disconnected():
+                try:
+                    message = await asyncio.wait_for(queue.get(), timeout=liveKeepaliveSeconds)
+                except asyncio.TimeoutError:
+                    message = ": keepalive\n\n"
+                yield message
+        finally:
+            liveHub.unsubscribe(channel, queue)
+
+    return StreamingResponse(
+        stream(),
+        media_type="text/event-stream",
+        headers={"Cache-Control": "no-cache", "X-Accel-Buffering": "no"},
+    )
+
+
 #api request to create a new key
 @app.post("/createApiKey/")
 def api_create_apikey():
@@ -191,9 +1040,35 @@ def api_create_apikey():
 def get_dashboard():
 	    return FileResponse("dashboard/dashboard.html")
 
+@app.get("/dashboard/analytics_worker.js")
+def get_analytics_worker():
+    return FileResponse("dashboard/analytics_worker.js", media_type="application/javascript")
+
+#headless compute benchmark for the analytics worker
+@app.get("/dashboard/bench")
+def get_dashboard_bench():
+    return FileResponse("dashboard/bench.html")
+
 @app.on_event("startup")
 def startup_event():
     load_apikeys()
 
+@app.on_event("startup")
+async def start_live_hub():
+    liveHub.loop = asyncio.get_running_loop()
+
+#retention: compact old months now and then once per interval, off the event loop
+@app.on_event("startup")
+async def start_compaction():
+    async def compaction_loop():
+        while True:
+            try:
+                result = await asyncio.get_running_loop().run_in_executor(None, compact_movements)
+                print(f"Compaction: {result['moved']} movements archived from {result['months']} device months")
+            except Exception as e:
+                print(f"Compaction failed: {str(e)}")
+            await asyncio.sleep(compactIntervalSeconds)
+    asyncio.create_task(compaction_loop())
+
 if __name__ == "__main__":
     uvicorn.run("main:app", host="0.0.0.0", port=8000, reload=True)
\ No newline at end of file
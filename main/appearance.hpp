@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//coarse colour signature of a pedestrian box, fixed 64 bytes per track
+//4x4x4 RGB histogram (top 2 bits per channel) normalised so bins add up to ~255
+struct Appearance {
+    static const int BINS = 64;
+    uint8_t hist[BINS];
+};
+
+//fill signature from an RGB565 frame in camera byte order (high byte first)
+//samples every `step` pixel in x and y, one branch free pass over the box
+inline void computeAppearance(const uint8_t* frame, int width, int height, int x1, int y1, int x2, int y2, Appearance* out, int step = 2)
+{
+    uint32_t counts[Appearance::BINS] = {0};
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > width) x2 = width;
+    if (y2 > height) y2 = height;
+
+    uint32_t total = 0;
+    for (int y = y1; y < y2; y += step) {
+        const uint8_t* px = frame + ((size_t)y * width + x1) * 2;
+        for (int x = x1; x < x2; x += step, px += step * 2) {
+            //hi = RRRRRGGG, lo = GGGBBBBB
+            uint8_t hi = px[0];
+            uint8_t lo = px[1];
+            counts[((hi >> 6) << 4) | (((hi >> 1) & 3) << 2) | ((lo >> 3) & 3)]++;
+        }
+        total += (x2 > x1) ? (uint32_t)((x2 - x1 + step - 1) / step) : 0;
+    }
+
+    for (int i = 0; i < Appearance::BINS; i++) {
+        out->hist[i] = total ? (uint8_t)((counts[i] * 255) / total) : 0;
+    }
+}
+
+//histogram intersection, 1.0 = same colours, 0.0 = nothing in common
+inline float appearanceSimilarity(const Appearance& a, const Appearance& b)
+{
+    uint32_t shared = 0;
+    for (int i = 0; i < Appearance::BINS; i++) {
+        shared += (a.hist[i] < b.hist[i]) ? a.hist[i] : b.hist[i];
+    }
+    return shared / 255.0f;
+}
+
+//smooth a track's signature with the latest box so one partly hidden frame does not replace it
+inline void blendAppearance(Appearance* track, const Appearance& latest)
+{
+    for (int i = 0; i < Appearance::BINS; i++) {
+        track->hist[i] = (uint8_t)((track->hist[i] + latest.hist[i] + 1) / 2);
+    }
+}
@@ -0,0 +1,285 @@
+#include "detector.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "dl_image_jpeg.hpp"
+#include "pedestrian_detect.hpp"
+#include "coco_detect.hpp"
+#include "frame_source.hpp"
+#include "motion_blob.hpp"
+
+static const char* TAG = "detector";
+
+static const char* NVS_NAMESPACE = "detector";
+static const char* NVS_KEY = "backend";
+
+//minimum scores per backend
+static const float PEDESTRIAN_MIN_SCORE = 0.75f;
+static const float COCO_PERSON_MIN_SCORE = 0.5f;
+static const float MOTION_MIN_FILL = 0.3f; //share of a blob's bounding box that is moving
+
+
+//any esp-dl detection model (run() on an img_t), optionally keeping one category
+template <class Model>
+class EspDlDetector : public Detector {
+public:
+    EspDlDetector(const char* backend, Model* model, int category, float threshold)
+        : Detector(threshold), backend(backend), model(model), category(category)
+    {
+    }
+
+    ~EspDlDetector() override { delete model; }
+
+    const char* name() const override { return backend; }
+
+    void detect(uint8_t* rgb565, int width, int height, std::vector<Detection>& out) override
+    {
+        out.clear();
+        dl::image::img_t img{rgb565, (uint16_t)width, (uint16_t)height, dl::image::DL_IMAGE_PIX_TYPE_RGB565};
+        auto& results = model->run(img);
+        for (const auto& r : results) {
+            if ((category >= 0 && r.category != category) || r.score < threshold()) {
+                continue;
+            }
+            out.push_back({r.box[0], r.box[1], r.box[2], r.box[3], r.score});
+        }
+    }
+
+private:
+    const char* backend;
+    Model* model;
+    int category; //-1 = every category
+};
+
+
+//moving cells of a coarse luma grid (see motion_blob.hpp), connected ones become one box; no model
+//and a few KB of state, people walking close together merge into one blob
+class MotionBlobDetector : public Detector {
+public:
+    MotionBlobDetector() : Detector(MOTION_MIN_FILL) {}
+
+    const char* name() const override { return "motion"; }
+
+    void detect(uint8_t* rgb565, int width, int height, std::vector<Detection>& out) override
+    {
+        out.clear();
+        grid.detect(rgb565, width, height, threshold(), boxes);
+        for (const auto& b : boxes) {
+            out.push_back({b.x1, b.y1, b.x2, b.y2, b.fill});
+        }
+    }
+
+private:
+    MotionBlob grid;
+    std::vector<MotionBlob::Box> boxes;
+};
+
+
+static Detector* create_pedestrian()
+{
+    return new EspDlDetector<PedestrianDetect>("pedestrian", new PedestrianDetect(), -1, PEDESTRIAN_MIN_SCORE);
+}
+
+//yolo11n at 320x320 input (the smallest coco variant, the others take 640x640), person is category 0
+//only this variant is flashed (sdkconfig), it needs the 6 MB factory partition next to the pedestrian model
+static Detector* create_coco_person()
+{
+    return new EspDlDetector<COCODetect>("coco_person_320", new COCODetect(COCODetect::YOLO11N_320_S8_V3), 0, COCO_PERSON_MIN_SCORE);
+}
+
+static Detector* create_motion()
+{
+    return new MotionBlobDetector();
+}
+
+struct Backend {
+    const char* name;
+    Detector* (*create)();
+};
+
+static const Backend kBackends[] = {
+    {"pedestrian", create_pedestrian},
+    {"coco_person_320", create_coco_person},
+    {"motion", create_motion},
+};
+static const size_t BACKEND_COUNT = sizeof(kBackends) / sizeof(kBackends[0]);
+
+size_t detector_count()
+{
+    return BACKEND_COUNT;
+}
+
+const char* detector_name(size_t index)
+{
+    return index < BACKEND_COUNT ? kBackends[index].name : nullptr;
+}
+
+Detector* create_detector(const char* name)
+{
+    for (size_t i = 0; i < BACKEND_COUNT; i++) {
+        if (name && strcmp(name, kBackends[i].name) == 0) {
+            return kBackends[i].create();
+        }
+    }
+    return nullptr;
+}
+
+
+const char* detector_configured()
+{
+    char stored[32] = "";
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(stored);
+        if (nvs_get_str(nvs, NVS_KEY, stored, &len) != ESP_OK) {
+            stored[0] = '\0';
+        }
+        nvs_close(nvs);
+    }
+    for (size_t i = 0; i < BACKEND_COUNT; i++) {
+        if (strcmp(stored, kBackends[i].name) == 0) {
+            return kBackends[i].name;
+        }
+    }
+    if (stored[0]) {
+        ESP_LOGW(TAG, "backend \"%s\" is not in this build, using %s", stored, DETECTOR_DEFAULT);
+    }
+    return DETECTOR_DEFAULT;
+}
+
+esp_err_t detector_configure(const char* name)
+{
+    bool known = false;
+    for (size_t i = 0; i < BACKEND_COUNT && !known; i++) {
+        known = name && strcmp(name, kBackends[i].name) == 0;
+    }
+    if (!known) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_str(nvs, NVS_KEY, name);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+
+size_t detector_benchmark(FrameSource& source, const char* truth_path, DetectorBenchResult* results, size_t max_results, bool* against_truth)
+{
+    size_t count = BACKEND_COUNT < max_results ? BACKEND_COUNT : max_results;
+    Detector* detectors[BACKEND_COUNT] = {};
+    uint64_t total_us[BACKEND_COUNT] = {};
+
+    //load one at a time so each heap delta belongs to one backend
+    for (size_t i = 0; i < count; i++) {
+        DetectorBenchResult& r = results[i];
+        memset(&r, 0, sizeof(r));
+        r.name = kBackends[i].name;
+        size_t heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        size_t internal = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+        detectors[i] = kBackends[i].create();
+        r.loaded = detectors[i] != nullptr;
+        r.heap_bytes = (int32_t)(heap - heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        r.internal_bytes = (int32_t)(internal - heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+    }
+
+    FILE* truth = truth_path ? fopen(truth_path, "r") : nullptr;
+    *against_truth = truth != nullptr;
+    ESP_LOGI(TAG, "benchmarking %u backends on %s, counts checked against %s", (unsigned)count, source.name(),
+             truth ? truth_path : (count ? kBackends[0].name : "nothing"));
+
+    std::vector<Detection> found;
+    found.reserve(32);
+    Frame frame = {};
+    while (source.get(frame)) {
+        int reference = -1;
+        if (truth && fscanf(truth, "%d", &reference) != 1) {
+            reference = -1; //truth file shorter than the footage
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (!detectors[i]) {
+                continue;
+            }
+            DetectorBenchResult& r = results[i];
+            //esp-dl allocates part of a model on its first run, count that as the model's memory too
+            size_t heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+            size_t internal = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+
+            int64_t started = esp_timer_get_time();
+            detectors[i]->detect(frame.buf, frame.width, frame.height, found);
+            uint32_t elapsed = (uint32_t)(esp_timer_get_time() - started);
+
+            if (!r.frames) {
+                r.heap_bytes += (int32_t)(heap - heap_caps_get_free_size(MALLOC_CAP_8BIT));
+                r.internal_bytes += (int32_t)(internal - heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+            }
+            r.frames++;
+            total_us[i] += elapsed;
+            if (elapsed > r.max_us) r.max_us = elapsed;
+
+            int people = (int)found.size();
+            if (!truth && i == 0) {
+                reference = people;
+            }
+            if (reference >= 0) {
+                r.compared++;
+                r.count_abs_error += (uint32_t)abs(people - reference);
+                if (people == reference) r.count_exact++;
+            }
+        }
+        source.release(frame);
+        //let the idle tasks run between frames, a full pass can take seconds
+        vTaskDelay(1);
+    }
+
+    if (truth) {
+        fclose(truth);
+    }
+    for (size_t i = 0; i < count; i++) {
+        DetectorBenchResult& r = results[i];
+        r.avg_us = r.frames ? (uint32_t)(total_us[i] / r.frames) : 0;
+        ESP_LOGI(TAG, "%s%s: %u frames, avg %u us, max %u us, heap %d B (internal %d B), count error %.2f/frame, exact %u%%",
+                 r.name, r.loaded ? "" : " (not loaded)", (unsigned)r.frames, (unsigned)r.avg_us, (unsigned)r.max_us,
+                 (int)r.heap_bytes, (int)r.internal_bytes, r.compared ? (double)r.count_abs_error / r.compared : 0.0,
+                 (unsigned)(r.compared ? r.count_exact * 100 / r.compared : 0));
+        delete detectors[i];
+    }
+    return count;
+}
+
+size_t detector_bench_json(char* buf, size_t len, const DetectorBenchResult* results, size_t count, bool against_truth)
+{
+    int n = snprintf(buf, len, "{\"reference\":\"%s\",\"backends\":[", against_truth ? "truth" : (count ? results[0].name : ""));
+    if (n < 0 || (size_t)n >= len) return 0;
+    size_t used = n;
+
+    for (size_t i = 0; i < count; i++) {
+        const DetectorBenchResult& r = results[i];
+        n = snprintf(buf + used, len - used,
+                     "%s{\"name\":\"%s\",\"loaded\":%s,\"frames\":%u,\"avg_us\":%u,\"max_us\":%u,\"heap_bytes\":%d,\"internal_bytes\":%d,"
+                     "\"compared\":%u,\"count_abs_error\":%u,\"count_exact\":%u}",
+                     i ? "," : "", r.name, r.loaded ? "true" : "false", (unsigned)r.frames, (unsigned)r.avg_us, (unsigned)r.max_us,
+                     (int)r.heap_bytes, (int)r.internal_bytes, (unsigned)r.compared, (unsigned)r.count_abs_error, (unsigned)r.count_exact);
+        if (n < 0 || (size_t)n >= len - used) return 0;
+        used += n;
+    }
+
+    n = snprintf(buf + used, len - used, "]}");
+    if (n < 0 || (size_t)n >= len - used) return 0;
+    return used + n;
+}
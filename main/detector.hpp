@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "esp_err.h"
+
+class FrameSource;
+
+//person detectors behind one interface so the backend can be chosen per store
+//esp-dl models for accuracy, a motion blob detector (no model) for very low power
+//the backend is read from NVS at boot (namespace "detector", key "backend")
+
+#define DETECTOR_DEFAULT "pedestrian"
+
+//box in frame pixels (x2/y2 exclusive)
+struct Detection {
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    float score;
+};
+
+class Detector {
+public:
+    virtual ~Detector() = default;
+
+    virtual const char* name() const = 0;
+
+    //find people in an RGB565 frame (camera byte order), out is replaced with boxes scoring >= threshold()
+    virtual void detect(uint8_t* rgb565, int width, int height, std::vector<Detection>& out) = 0;
+
+    float threshold() const { return min_score; }
+    void set_threshold(float score) { min_score = score; }
+
+protected:
+    explicit Detector(float threshold) : min_score(threshold) {}
+
+private:
+    float min_score;
+};
+
+
+//backends compiled into this build, in benchmark order (the first one is the reference)
+size_t detector_count();
+const char* detector_name(size_t index);
+
+//load a backend by name, nullptr if the name is unknown
+Detector* create_detector(const char* name);
+
+//backend stored in NVS, DETECTOR_DEFAULT if unset or not in this build (nvs_flash_init must have run)
+const char* detector_configured();
+
+//store the backend for the next boot, ESP_ERR_NOT_FOUND if it is not in this build
+esp_err_t detector_configure(const char* name);
+
+
+struct DetectorBenchResult {
+    const char* name;
+    bool loaded;
+    uint32_t frames;
+    uint32_t avg_us;           //detect() latency
+    uint32_t max_us;
+    int32_t heap_bytes;        //heap held once loaded and run on the first frame
+    int32_t internal_bytes;    //part of it in internal RAM
+    uint32_t compared;         //frames with a reference count
+    uint32_t count_abs_error;  //sum of |count - reference| over compared frames
+    uint32_t count_exact;      //compared frames with exactly the reference count
+};
+
+//run every backend on each frame of source (all see the same frames, in order) until it finishes
+//counts are checked against truth_path (one person count per line, one line per frame) when it
+//can be opened, otherwise against the first backend; returns number of results filled
+size_t detector_benchmark(FrameSource& source, const char* truth_path, DetectorBenchResult* results, size_t max_results, bool* against_truth);
+
+//results as json, returns bytes written, 0 if buf is too small
+size_t detector_bench_json(char* buf, size_t len, const DetectorBenchResult* results, size_t count, bool against_truth);
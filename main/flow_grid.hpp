@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//where people stand and which way they walk, accumulated on a fixed grid over the frame
+//memory and cost per tracked person do not depend on how busy the entrance is
+
+struct FlowCell {
+    uint32_t occupancy_ms;  //person-milliseconds spent in the cell
+    uint16_t directions[8]; //steps that left the cell: E, NE, N, NW, W, SW, S, SE (N = up in the image)
+};
+
+class FlowGrid {
+public:
+    static const int COLS = 16;
+    static const int ROWS = 12;
+    static const int CELLS = COLS * ROWS;
+    static const int DIRECTIONS = 8;
+    static const int MIN_STEP = 2; //pixels, smaller moves are detector jitter
+
+    void init(int frame_width, int frame_height)
+    {
+        width = frame_width > 0 ? frame_width : 1;
+        height = frame_height > 0 ? frame_height : 1;
+        clear();
+    }
+
+    void clear()
+    {
+        memset(cells, 0, sizeof(cells));
+    }
+
+    //person seen at (x, y) for dt_ms
+    void occupy(int x, int y, uint32_t dt_ms)
+    {
+        cells[cell_index(x, y)].occupancy_ms += dt_ms;
+    }
+
+    //person moved from (x0, y0) to (x1, y1) between two frames, counted in the cell it left
+    void step(int x0, int y0, int x1, int y1)
+    {
+        int dx = x1 - x0;
+        int dy = y0 - y1; //image y grows downwards
+        int ax = dx < 0 ? -dx : dx;
+        int ay = dy < 0 ? -dy : dy;
+        if (ax + ay < MIN_STEP) return;
+
+        //octant without atan2: tan(22.5) ~ 2/5
+        int dir;
+        if (ay * 5 < ax * 2) {
+            dir = dx > 0 ? 0 : 4;
+        } else if (ax * 5 < ay * 2) {
+            dir = dy > 0 ? 2 : 6;
+        } else if (dx > 0) {
+            dir = dy > 0 ? 1 : 7;
+        } else {
+            dir = dy > 0 ? 3 : 5;
+        }
+
+        uint16_t& count = cells[cell_index(x0, y0)].directions[dir];
+        if (count < UINT16_MAX) count++;
+    }
+
+    const FlowCell& cell(int i) const { return cells[i]; }
+
+    //sparse json snapshot, only cells with data: {"start":s,"end":e,"cols":c,"rows":r,"cells":[[index,occupancy_ms,d0..d7],...]}
+    //returns bytes written, 0 if buf is too small
+    size_t to_json(char* buf, size_t len, int64_t start, int64_t end) const
+    {
+        int n = snprintf(buf, len, "{\"start\":%lld,\"end\":%lld,\"cols\":%d,\"rows\":%d,\"cells\":[",
+                         (long long)start, (long long)end, COLS, ROWS);
+        if (n < 0 || (size_t)n >= len) return 0;
+        size_t used = n;
+
+        bool first = true;
+        for (int i = 0; i < CELLS; i++) {
+            const FlowCell& c = cells[i];
+            if (!c.occupancy_ms && !has_steps(c)) continue;
+            n = snprintf(buf + used, len - used, "%s[%d,%u,%u,%u,%u,%u,%u,%u,%u,%u]", first ? "" : ",", i, (unsigned)c.occupancy_ms,
+                         c.directions[0], c.directions[1], c.directions[2], c.directions[3],
+                         c.directions[4], c.directions[5], c.directions[6], c.directions[7]);
+            if (n < 0 || (size_t)n >= len - used) return 0;
+            used += n;
+            first = false;
+        }
+
+        n = snprintf(buf + used, len - used, "]}");
+        if (n < 0 || (size_t)n >= len - used) return 0;
+        return used + n;
+    }
+
+    //worst case to_json size (every cell filled with maximum values)
+    static size_t json_capacity()
+    {
+        return 96 + (size_t)CELLS * (1 + 2 + 4 + 11 + DIRECTIONS * 6 + 1);
+    }
+
+private:
+    int cell_index(int x, int y) const
+    {
+        int cx = x * COLS / width;
+        int cy = y * ROWS / height;
+        if (cx < 0) cx = 0;
+        if (cx >= COLS) cx = COLS - 1;
+        if (cy < 0) cy = 0;
+        if (cy >= ROWS) cy = ROWS - 1;
+        return cy * COLS + cx;
+    }
+
+    static bool has_steps(const FlowCell& c)
+    {
+        for (int d = 0; d < DIRECTIONS; d++) {
+            if (c.directions[d]) return true;
+        }
+        return false;
+    }
+
+    int width = 1;
+    int height = 1;
+    FlowCell cells[CELLS];
+};
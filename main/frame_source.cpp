@@ -0,0 +1,378 @@
+#include "frame_source.hpp"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "jpeg_decoder.h"
+
+static const char* TAG = "frame_source";
+
+//largest jpeg frame accepted from a replay file
+#define REPLAY_JPEG_MAX (64 * 1024)
+
+//camera delivers RGB565 high byte first, generated and decoded frames follow the same order
+static inline void put_rgb565(uint16_t* pix, uint8_t r, uint8_t g, uint8_t b)
+{
+    uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    *pix = (uint16_t)((c >> 8) | (c << 8));
+}
+
+//psram if there is any, internal ram otherwise
+static uint8_t* alloc_frame(size_t len)
+{
+    uint8_t* buf = (uint8_t*)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        buf = (uint8_t*)heap_caps_malloc(len, MALLOC_CAP_8BIT);
+    }
+    return buf;
+}
+
+
+bool CameraFrameSource::get(Frame& frame)
+{
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+        return false;
+    }
+    frame.buf = fb->buf;
+    frame.len = fb->len;
+    frame.width = fb->width;
+    frame.height = fb->height;
+    frame.format = fb->format;
+    frame.handle = fb;
+
+    //cam_hal stamps each frame from esp_timer_get_time() (time since boot, not wall clock) when the
+    //transfer ended, so it is already in esp_timer time and covers any wait in the driver queue
+    frame.captured_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    return true;
+}
+
+void CameraFrameSource::release(Frame& frame)
+{
+    if (frame.handle) {
+        esp_camera_fb_return((camera_fb_t*)frame.handle);
+    }
+    frame.handle = nullptr;
+    frame.buf = nullptr;
+}
+
+
+PooledFrameSource::PooledFrameSource(int width, int height, int slots, int fps)
+    : width(width), height(height), frame_len((size_t)width * height * 2)
+{
+    if (slots > MAX_SLOTS) slots = MAX_SLOTS;
+    if (slots < 1) slots = 1;
+
+    free_slots = xQueueCreate(MAX_SLOTS, sizeof(int));
+    if (!free_slots) {
+        ESP_LOGE(TAG, "Could not create frame pool queue");
+        return;
+    }
+    for (int i = 0; i < slots; i++) {
+        slot_buf[i] = alloc_frame(frame_len);
+        if (!slot_buf[i]) {
+            ESP_LOGE(TAG, "Could not allocate frame buffer %d (%u bytes)", i, (unsigned)frame_len);
+            break;
+        }
+        xQueueSend(free_slots, &i, 0);
+        slot_count++;
+    }
+
+    period = (fps > 0) ? pdMS_TO_TICKS(1000 / fps) : 0;
+}
+
+PooledFrameSource::~PooledFrameSource()
+{
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        free(slot_buf[i]);
+    }
+    if (free_slots) {
+        vQueueDelete(free_slots);
+    }
+}
+
+bool PooledFrameSource::acquire(Frame& frame)
+{
+    int slot = -1;
+    if (slot_count == 0 || xQueueReceive(free_slots, &slot, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    //throttle to requested fps, unthrottled when period is 0
+    if (period > 0) {
+        if (last_tick == 0) last_tick = xTaskGetTickCount();
+        vTaskDelayUntil(&last_tick, period);
+    }
+
+    frame.buf = slot_buf[slot];
+    frame.len = frame_len;
+    frame.width = width;
+    frame.height = height;
+    frame.format = PIXFORMAT_RGB565;
+    frame.handle = (void*)(intptr_t)(slot + 1); //keep 0 as "no slot"
+    return true;
+}
+
+void PooledFrameSource::release(Frame& frame)
+{
+    int slot = (int)(intptr_t)frame.handle - 1;
+    if (slot >= 0 && slot < slot_count) {
+        xQueueSend(free_slots, &slot, 0);
+    }
+    frame.handle = nullptr;
+    frame.buf = nullptr;
+}
+
+
+ReplayFrameSource::ReplayFrameSource(const char* path, ReplayFormat format, int width, int height, int fps, bool loop)
+    : PooledFrameSource(width, height, MAX_SLOTS, fps), format(format), loop(loop)
+{
+    file = fopen(path, "rb");
+    if (!file) {
+        ESP_LOGE(TAG, "Could not open replay file %s", path);
+        done = true;
+        return;
+    }
+    if (format == REPLAY_MJPEG) {
+        jpeg_cap = REPLAY_JPEG_MAX;
+        jpeg_buf = alloc_frame(jpeg_cap);
+        if (!jpeg_buf) {
+            ESP_LOGE(TAG, "Could not allocate jpeg scratch buffer");
+            done = true;
+        }
+    }
+    ESP_LOGI(TAG, "Replaying %s (%s %dx%d, %s)", path, format == REPLAY_MJPEG ? "mjpeg" : "rgb565", width, height, loop ? "loop" : "once");
+}
+
+ReplayFrameSource::~ReplayFrameSource()
+{
+    if (file) fclose(file);
+    free(jpeg_buf);
+}
+
+bool ReplayFrameSource::rewind_or_finish()
+{
+    if (!loop) {
+        done = true;
+        return false;
+    }
+    //a whole pass without a usable frame would only repeat, stop instead of spinning camera_task
+    if (!delivered) {
+        ESP_LOGE(TAG, "Replay file has no usable frame, stopping");
+        done = true;
+        return false;
+    }
+    delivered = false;
+    rewind(file);
+    return true;
+}
+
+bool ReplayFrameSource::read_rgb565(uint8_t* out)
+{
+    if (fread(out, 1, frame_len, file) == frame_len) {
+        return true;
+    }
+    //short read means end of file, drop the partial frame
+    if (!rewind_or_finish()) return false;
+    return fread(out, 1, frame_len, file) == frame_len;
+}
+
+//until a frame decodes, rewind_or_finish() ends it when a whole pass had none
+bool ReplayFrameSource::read_mjpeg(uint8_t* out)
+{
+    while (true) {
+        //skip to start of image marker
+        int prev = -1, c;
+        while ((c = fgetc(file)) != EOF) {
+            if (prev == 0xFF && c == 0xD8) break;
+            prev = c;
+        }
+        if (c == EOF) {
+            if (!rewind_or_finish()) return false;
+            continue;
+        }
+
+        //copy until end of image marker
+        size_t n = 0;
+        jpeg_buf[n++] = 0xFF;
+        jpeg_buf[n++] = 0xD8;
+        prev = -1;
+        bool complete = false;
+        while (n < jpeg_cap && (c = fgetc(file)) != EOF) {
+            jpeg_buf[n++] = (uint8_t)c;
+            if (prev == 0xFF && c == 0xD9) {
+                complete = true;
+                break;
+            }
+            prev = c;
+        }
+        if (!complete) {
+            if (n >= jpeg_cap) {
+                ESP_LOGW(TAG, "Replay jpeg frame larger than %u bytes, skipped", (unsigned)jpeg_cap);
+                continue;
+            }
+            if (!rewind_or_finish()) return false;
+            continue;
+        }
+
+        esp_jpeg_image_cfg_t cfg = {};
+        cfg.indata = jpeg_buf;
+        cfg.indata_size = n;
+        cfg.outbuf = out;
+        cfg.outbuf_size = frame_len;
+        cfg.out_format = JPEG_IMAGE_FORMAT_RGB565;
+        cfg.out_scale = JPEG_IMAGE_SCALE_0;
+        cfg.flags.swap_color_bytes = 1; //match camera byte order
+        esp_jpeg_image_output_t info = {};
+        esp_err_t err = esp_jpeg_decode(&cfg, &info);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Replay jpeg decode failed: %s", esp_err_to_name(err));
+            continue;
+        }
+        if (info.width != width || info.height != height) {
+            ESP_LOGW(TAG, "Replay frame is %dx%d, expected %dx%d", info.width, info.height, width, height);
+            continue;
+        }
+        return true;
+    }
+}
+
+bool ReplayFrameSource::get(Frame& frame)
+{
+    if (done || !opened()) return false;
+    if (!acquire(frame)) return false;
+
+    bool read = (format == REPLAY_MJPEG) ? read_mjpeg(frame.buf) : read_rgb565(frame.buf);
+    if (!read) {
+        release(frame);
+        return false;
+    }
+    delivered = true;
+    frame.captured_us = esp_timer_get_time();
+    return true;
+}
+
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, int fps, int boxes)
+    : PooledFrameSource(width, height, MAX_SLOTS, fps)
+{
+    if (boxes > MAX_BOXES) boxes = MAX_BOXES;
+    if (boxes < 0) boxes = 0;
+    box_count = boxes;
+
+    //spread boxes over the width, alternate walking in and out at different speeds
+    for (int i = 0; i < box_count; i++) {
+        Box& b = box_list[i];
+        b.w = width / 8;
+        b.h = height / 3;
+        b.x = (width - b.w) * (i + 1) / (box_count + 1);
+        b.y = (i * 37) % (height - b.h);
+        b.dy = ((i % 2) ? -1 : 1) * (1 + i % 3);
+        uint16_t c = 0;
+        put_rgb565(&c, 60 + 25 * i, 200 - 20 * i, 90 + 15 * i);
+        b.color = c;
+    }
+}
+
+void SyntheticFrameSource::render(uint16_t* pix)
+{
+    //vertical gradient background so the frame is not flat
+    for (int y = 0; y < height; y++) {
+        uint16_t bg = 0;
+        uint8_t v = (uint8_t)(40 + (y * 80) / height);
+        put_rgb565(&bg, v, v, v);
+        uint16_t* row = pix + y * width;
+        for (int x = 0; x < width; x++) {
+            row[x] = bg;
+        }
+    }
+
+    for (int i = 0; i < box_count; i++) {
+        Box& b = box_list[i];
+        for (int y = b.y; y < b.y + b.h; y++) {
+            uint16_t* row = pix + y * width;
+            for (int x = b.x; x < b.x + b.w; x++) {
+                row[x] = b.color;
+            }
+        }
+
+        //bounce at the edges so every box keeps crossing the middle
+        b.y += b.dy;
+        if (b.y < 0 || b.y + b.h > height) {
+            b.dy = -b.dy;
+            b.y += 2 * b.dy;
+        }
+    }
+}
+
+bool SyntheticFrameSource::get(Frame& frame)
+{
+    if (!acquire(frame)) return false;
+    render((uint16_t*)frame.buf);
+    frame.captured_us = esp_timer_get_time();
+    return true;
+}
+
+
+FrameMailbox::FrameMailbox(bool lossless) : lossless(lossless)
+{
+    ready = xSemaphoreCreateBinary();
+    if (lossless) {
+        space = xSemaphoreCreateBinary();
+        xSemaphoreGive(space);
+    }
+}
+
+FrameMailbox::~FrameMailbox()
+{
+    if (ready) vSemaphoreDelete(ready);
+    if (space) vSemaphoreDelete(space);
+}
+
+bool FrameMailbox::post(const Frame& frame, Frame& stale)
+{
+    if (lossless) {
+        xSemaphoreTake(space, portMAX_DELAY);
+    }
+
+    bool displaced;
+    portENTER_CRITICAL(&lock);
+    displaced = full;
+    if (displaced) {
+        stale = slot;
+    }
+    slot = frame;
+    full = true;
+    posted_count++;
+    if (displaced) {
+        dropped_count++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    //binary semaphore, several posts before a take still wake the consumer once
+    xSemaphoreGive(ready);
+    return displaced;
+}
+
+bool FrameMailbox::take(Frame& frame, TickType_t timeout)
+{
+    if (xSemaphoreTake(ready, timeout) != pdTRUE) {
+        return false;
+    }
+
+    bool got;
+    portENTER_CRITICAL(&lock);
+    got = full;
+    if (got) {
+        frame = slot;
+        full = false;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (got && lossless) {
+        xSemaphoreGive(space);
+    }
+    return got;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+//frame handed out by a source, the buffer belongs to the source until release() is called
+struct Frame {
+    uint8_t* buf;
+    size_t len;
+    int width;
+    int height;
+    pixformat_t format;
+    void* handle; //source specific (camera fb or pool slot)
+    int64_t captured_us; //esp_timer time the frame was captured, carried through tracking
+};
+
+//where camera_task gets its frames from (live camera, recorded footage or generated)
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual const char* name() const = 0;
+
+    //block until next frame is ready, false if capture failed
+    virtual bool get(Frame& frame) = 0;
+
+    //hand the buffer back so it can be reused
+    virtual void release(Frame& frame) = 0;
+
+    //true once a finite source (replay without loop) has nothing left
+    virtual bool finished() const { return false; }
+};
+
+
+//OV3660 through esp32-camera, camera must already be initialized
+class CameraFrameSource : public FrameSource {
+public:
+    const char* name() const override { return "camera"; }
+    bool get(Frame& frame) override;
+    void release(Frame& frame) override;
+};
+
+
+//fixed pool of RGB565 buffers for sources that fill frames themselves
+//same number of buffers as the camera driver so back pressure behaves alike
+class PooledFrameSource : public FrameSource {
+public:
+    static const int MAX_SLOTS = 2;
+
+    ~PooledFrameSource() override;
+    void release(Frame& frame) override;
+
+    bool ok() const { return slot_count > 0; }
+
+protected:
+    //fps = 0 means run as fast as the pipeline takes frames
+    PooledFrameSource(int width, int height, int slots, int fps);
+
+    //grab a free buffer (blocks while pipeline holds all of them) and pace to fps
+    bool acquire(Frame& frame);
+
+    int width;
+    int height;
+    size_t frame_len;
+
+private:
+    uint8_t* slot_buf[MAX_SLOTS] = {};
+    int slot_count = 0;
+    QueueHandle_t free_slots = nullptr;
+    TickType_t period = 0;
+    TickType_t last_tick = 0;
+};
+
+
+enum ReplayFormat {
+    REPLAY_RGB565, //raw frames of width*height*2 bytes back to back
+    REPLAY_MJPEG   //concatenated jpeg images (SOI..EOI), decoded to RGB565
+};
+
+//replays recorded footage from a file on the SPIFFS storage partition
+class ReplayFrameSource : public PooledFrameSource {
+public:
+    ReplayFrameSource(const char* path, ReplayFormat format, int width, int height, int fps, bool loop);
+    ~ReplayFrameSource() override;
+
+    const char* name() const override { return "replay"; }
+    bool get(Frame& frame) override;
+    bool finished() const override { return done; }
+
+    //true if file opened and buffers allocated
+    bool opened() const { return file != nullptr && ok(); }
+
+private:
+    bool read_rgb565(uint8_t* out);
+    bool read_mjpeg(uint8_t* out);
+    bool rewind_or_finish();
+
+    FILE* file = nullptr;
+    ReplayFormat format;
+    bool loop;
+    bool done = false;
+    bool delivered = false; //a frame was read since the last rewind
+
+    //scratch for one compressed jpeg frame
+    uint8_t* jpeg_buf = nullptr;
+    size_t jpeg_cap = 0;
+};
+
+
+//generates frames with boxes walking up and down across the frame
+//handy to load the pipeline without a camera or any recordings
+class SyntheticFrameSource : public PooledFrameSource {
+public:
+    static const int MAX_BOXES = 8;
+
+    SyntheticFrameSource(int width, int height, int fps, int boxes);
+
+    const char* name() const override { return "synthetic"; }
+    bool get(Frame& frame) override;
+
+private:
+    struct Box {
+        int x;
+        int y;
+        int w;
+        int h;
+        int dy;
+        uint16_t color;
+    };
+
+    void render(uint16_t* pix);
+
+    Box box_list[MAX_BOXES];
+    int box_count;
+};
+
+
+//single slot hand off between camera_task and ml_task, the newest frame wins
+//post() replaces a frame that was not taken yet and hands it back so the producer can release it
+//lossless mode makes post() wait for the slot instead (replay runs that must see every frame)
+class FrameMailbox {
+public:
+    explicit FrameMailbox(bool lossless);
+    ~FrameMailbox();
+
+    //publish frame, true if an older untaken frame was displaced into stale
+    bool post(const Frame& frame, Frame& stale);
+
+    //wait up to timeout for the newest frame
+    bool take(Frame& frame, TickType_t timeout);
+
+    uint32_t posted() const { return posted_count; }
+    uint32_t dropped() const { return dropped_count; }
+
+private:
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    SemaphoreHandle_t ready = nullptr; //given when the slot gets a frame
+    SemaphoreHandle_t space = nullptr; //given when the slot is emptied (lossless only)
+    Frame slot = {};
+    bool full = false;
+    bool lossless;
+    volatile uint32_t posted_count = 0;
+    volatile uint32_t dropped_count = 0;
+};
@@ -15,21 +15,67 @@
     #include "freertos/FreeRTOS.h"
     #include "freertos/task.h"
     #include "esp_task_wdt.h"
+    #include "esp_timer.h"
     #include "dl_image_jpeg.hpp"
-    #include "pedestrian_detect.hpp"
     #include <stdlib.h>
     #include <queue>
     #include <time.h>
     #include "esp_http_client.h"
     #include "esp_sntp.h"
+    #include "esp_spiffs.h"
+    #include "frame_source.hpp"
+    #include "appearance.hpp"
+    #include "task_budget.hpp"
+    #include "flow_grid.hpp"
+    #include "trace.hpp"
+    #include "detector.hpp"
+    #include "tracker.hpp"
     
-    //marker line to figure out if user entered or exited
-    #define LineY 60
-
-    //Range in which centroid assumes its the same pedestrian
-    #define samePedestrianX 10
-    #define samePedestrianY 15
-    #define pedestrianThreshold 0.75
+    //line, match ranges and track recovery settings live in tracker.hpp
+    #define REID_STATS_FRAMES 100     //log descriptor cost and recoveries every n frames
+
+    //where frames come from: live camera, recorded file or generated boxes
+    #define FRAME_SOURCE_CAMERA 0
+    #define FRAME_SOURCE_REPLAY 1
+    #define FRAME_SOURCE_SYNTHETIC 2
+    #define FRAME_SOURCE FRAME_SOURCE_CAMERA
+
+    //replay/synthetic settings (fps 0 = as fast as the pipeline can go)
+    #define FRAME_WIDTH 160
+    #define FRAME_HEIGHT 120
+    #define REPLAY_PATH "/storage/replay.rgb565"
+    #define REPLAY_FORMAT REPLAY_RGB565 //or REPLAY_MJPEG
+    #define REPLAY_FPS 0
+    #define REPLAY_LOOP false
+    #define SYNTHETIC_BOXES 3
+    //the esp-dl models do not take flat boxes for people, so synthetic runs use this backend instead of
+    //the NVS one to put load on tracking and counting too ("" keeps the NVS choice)
+    #define SYNTHETIC_DETECTOR "motion"
+
+    //detector backend is picked at boot from NVS (POST its name to /detector, applies after restart)
+    //benchmark mode first runs every backend over REPLAY_PATH and serves the comparison on /detector
+    #define DETECTOR_BENCHMARK 0
+    #define DETECTOR_BENCH_TRUTH REPLAY_PATH ".counts" //optional person count per frame, one per line
+
+    //cooperative scheduling: tasks only sleep when over budget or starving lower priority work
+    #define ML_BUDGET_US 100000            //longest ml_task runs before sleeping a tick
+    #define CAMERA_BUDGET_US 50000         //same for camera_task
+    #define STARVE_US 50000                //yield early once the idle task of the core has not run this long
+    #define SCHED_STATS_PERIOD_US 10000000 //fps/yield stats window, logged and served on /stats
+    #define ML_WAIT_MS 1000                //frame wait before ml_task reports itself idle to the watchdog
+
+    //camera_task -> ml_task hand off keeps only the newest frame, stale ones are dropped
+    //a replay/synthetic run paced by the pipeline (fps 0) is lossless instead so every frame is processed
+    #define MAILBOX_LOSSLESS (FRAME_SOURCE != FRAME_SOURCE_CAMERA && REPLAY_FPS == 0)
+
+    //heatmap / walking direction grid (see flow_grid.hpp), uploaded as one snapshot per period
+    #define FLOW_REPORT_PERIOD_MS 60000
+    #define FLOW_MAX_DT_MS 1000 //longest frame gap credited as occupancy (pipeline pauses)
+
+    //per frame/per event messages go through trace.hpp, printed later by a low priority task
+    #define TRACE_DRAIN_MS 500
+    #define TRACE_TASK_PRIORITY 1
+    #define TRACE_MEASURE_AT_BOOT 1 //log trace() vs ESP_LOGI cost once at startup
 
     #define wifiSSID ""
     #define wifiPASSWORD ""
@@ -44,27 +90,30 @@
     static const char* TAG = "stream";
 
     //queues
-    QueueHandle_t camera_queue;  //Camera to ML
+    static FrameMailbox* camera_mailbox = nullptr; //Camera to ML (newest frame wins)
     QueueHandle_t stream_queue;  //ML to Stream
     QueueHandle_t movement_queue; //entries/exits to report
 
 
-    //pedestrian detector
-    static PedestrianDetect* pmodel = nullptr;
-    struct Pedestrian {
-        int x1;
-        int x2;
-        int y1;
-        int y2;
-        int centroidX;
-        int centroidY;
-
-        Pedestrian() = default;
+    //frame source used by camera task and legacy stream
+    static FrameSource* g_frame_source = nullptr;
 
-        Pedestrian& operator=(const Pedestrian& other) = default;
+    //scheduling budgets and responsiveness stats
+    static TaskBudget s_camera_budget("camera_task", CAMERA_BUDGET_US, STARVE_US, SCHED_STATS_PERIOD_US);
+    static TaskBudget s_ml_budget("ml_task", ML_BUDGET_US, STARVE_US, SCHED_STATS_PERIOD_US);
+    static volatile uint32_t s_report_late_max_ms = 0; //worst report_task wake up delay
 
+    //capture to decision latency (frame captured -> crossings decided), upper bucket edges in ms
+    static const uint32_t kLatencyEdgesMs[] = {25, 50, 100, 200, 400, 800, 1600};
+    #define LATENCY_BUCKETS (sizeof(kLatencyEdgesMs) / sizeof(kLatencyEdgesMs[0]) + 1)
+    static volatile uint32_t s_latency_hist[LATENCY_BUCKETS] = {};
+    static volatile uint32_t s_latency_max_ms = 0;
 
-    };
+    //pedestrian detector (backend from NVS, see detector.hpp)
+    static Detector* g_detector = nullptr;
+    static DetectorBenchResult s_bench[8];
+    static size_t s_bench_count = 0;
+    static bool s_bench_truth = false;
 
     typedef struct {
         uint8_t *buf;
@@ -73,7 +122,7 @@
 
     //movement event (entry = 1, exit = 0)
     struct MovementEvent {
-        int64_t timestamp; //unix time
+        int64_t timestamp; //unix time the frame showing the crossing was captured
         int is_entry;      //1 = entry, 0 = exit
     };
 
@@ -84,22 +133,28 @@
     #define REPORT_BATCH_MAX 20
     #define REPORT_PERIOD_MS 10000
 
-    //get unix time (0 if not set yet)
-    static inline int64_t get_unix_time()
+    //unix time of a frame captured at esp_timer time captured_us (near 0 if not set yet)
+    static inline int64_t capture_unix_time(int64_t captured_us)
     {
-        return (int64_t)time(NULL);
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        int64_t now_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+        return (now_us - (esp_timer_get_time() - captured_us)) / 1000000;
     }
 
     //push movement to queue
-    void record_movement(int is_entry)
+    void record_movement(int is_entry, int64_t captured_us)
     {
         MovementEvent evt;
-        evt.timestamp = get_unix_time();
+        evt.timestamp = capture_unix_time(captured_us);
         evt.is_entry = is_entry ? 1 : 0;
         if (movement_queue) 
         {
-            xQueueSend(movement_queue, &evt, 0);
-            printf("Recorded movement event: %s at %lld\n", is_entry ? "entry" : "exit", (long long)evt.timestamp);
+            if (xQueueSend(movement_queue, &evt, 0) != pdTRUE) {
+                trace(TRACE_MOVEMENT_DROPPED, (int32_t)evt.timestamp);
+                return;
+            }
+            trace(is_entry ? TRACE_ENTRY_RECORDED : TRACE_EXIT_RECORDED, (int32_t)evt.timestamp);
         }
     }
 
@@ -168,34 +223,30 @@
         free(json);
     }
 
-
-    std::vector<Pedestrian> currentPedestrians;
-
-    //calculate centroid for x or y depending on input
-    void calculateCentroid(Pedestrian* p1)
+    //post a heatmap/direction snapshot
+    static void post_flow(const char* json, size_t len)
     {
-        int cx = (p1->x1 + p1->x2)/2;
-        int cy = (p1->y1 + p1->y2)/2;
-        p1->centroidX = cx;
-        p1->centroidY = cy;
-    }
-
-
-    //check if pedestrian is same as last frame
-    //This is achieved by seeing if the centroids are closer enough especially on the X axis
-    bool samePedestrian(const Pedestrian& p1, const Pedestrian& p2)
-    {  
-        int diffX = p1.centroidX - p2.centroidX;
-        int diffY = p1.centroidY - p2.centroidY;
-
+        char url[128];
+        snprintf(url, sizeof(url), "http://%s:%d/flow/?api_key=%s", DASHBOARD_HOST, DASHBOARD_PORT, DASHBOARD_API_KEY);
 
-        //check if between ranges
-        return (abs(diffX) <= samePedestrianX) && (abs(diffY) <= samePedestrianY);
+        esp_http_client_config_t cfg = {};
+        cfg.url = url;
+        cfg.method = HTTP_METHOD_POST;
+        esp_http_client_handle_t client = esp_http_client_init(&cfg);
+        if (client) {
+            esp_http_client_set_header(client, "Content-Type", "application/json");
+            esp_http_client_set_post_field(client, json, len);
+            esp_err_t err = esp_http_client_perform(client);
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "Reported flow snapshot (%u bytes) status=%d", (unsigned)len, esp_http_client_get_status_code(client));
+            } else {
+                ESP_LOGW(TAG, "Flow report failed: %s", esp_err_to_name(err));
+            }
+            esp_http_client_cleanup(client);
+        }
     }
 
 
-
-
     //convert RGB888 to RGB565 format
     inline uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) {
         return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
@@ -243,74 +294,57 @@
         
     }
 
-    //add new pedestrians into current list (only apply this with a list that has been filtered for same pedestrians)
-    void updatePedestrians(const std::vector<Pedestrian>& newPedestrians)
-    {
-        currentPedestrians.insert(currentPedestrians.end(), newPedestrians.begin(), newPedestrians.end());
-    }
+    //track recovery stats
+    static int64_t s_appearance_us = 0;
+    static uint32_t s_stats_frames = 0;
 
-    //remove non existent pedestrians & check for crossing the line
-    void prunePedestrians(const std::vector<Pedestrian>& newPedestrians)
+    //log descriptor cost and track recovery every REID_STATS_FRAMES frames
+    void log_track_stats()
     {
-        std::vector<Pedestrian> updatedPedestrians;
-
-        for (auto &oldPed : currentPedestrians) 
+        if (++s_stats_frames < REID_STATS_FRAMES) 
         {
-            bool found = false;
-            for (auto &newPed : newPedestrians) 
-            {
-                if (samePedestrian(oldPed, newPed)) 
-                {
-                    found = true;
-                    updatedPedestrians.push_back(newPed);
-                    //print found new ped
-                    ESP_LOGI(TAG, "Pedestrian still in frame at (%d, %d)", newPed.centroidX, newPed.centroidY);
-                    //check if crossed the line
-                    if ((oldPed.centroidY > LineY) && (newPed.centroidY <= LineY)) 
-                    {
-                        ESP_LOGI(TAG, "Pedestrian exited at (%d, %d)", newPed.centroidX, newPed.centroidY);
-                        record_movement(0); //exit
-                    } 
-                    else if ((oldPed.centroidY < LineY) && (newPed.centroidY >= LineY)) 
-                    {
-                        ESP_LOGI(TAG, "Pedestrian entered at (%d, %d)", newPed.centroidX, newPed.centroidY);
-                        record_movement(1); //entry
-                    }
-                    break;
-                }
-            }
-            //if not found it means pedestrian has left the frame
-            if (!found) 
-            {
-                ESP_LOGI(TAG, "Pedestrian left the frame at (%d, %d)", oldPed.centroidX, oldPed.centroidY);
-            }
+            return;
         }
-
-        currentPedestrians = updatedPedestrians;
+        TrackerStats stats = tracker_take_stats();
+        ESP_LOGI(TAG, "track recovery: descriptor %lld us/frame, %u recovered, %u left, %d lost now",
+                 (long long)(s_appearance_us / s_stats_frames), (unsigned)stats.recovered, (unsigned)stats.expired, stats.lost_now);
+        s_appearance_us = 0;
+        s_stats_frames = 0;
     }
-    //get new filtered pedestrians in the new list that arent already in the current list
-    std::vector<Pedestrian> filterNewPedestrians(const std::vector<Pedestrian>& newPedestrians)
+
+
+    //flow grids: ml_task adds to the active one, report_task swaps and uploads the other
+    static FlowGrid s_flow[2];
+    static int s_flow_active = 0;
+    static int64_t s_flow_started_us[2] = {0, 0}; //capture time the grid started collecting
+    static int64_t s_flow_last_us = 0;
+    static portMUX_TYPE s_flow_lock = portMUX_INITIALIZER_UNLOCKED;
+
+    void init_flow(int width, int height)
     {
-        std::vector<Pedestrian> filteredPedestrians;
+        s_flow[0].init(width, height);
+        s_flow[1].init(width, height);
+    }
 
-        for (const auto& newPed : newPedestrians) 
+    //credit every current track with the time since the last frame and its step
+    void update_flow(int64_t capturedUs)
+    {
+        int64_t dt_ms = s_flow_last_us ? (capturedUs - s_flow_last_us) / 1000 : 0;
+        if (dt_ms < 0) dt_ms = 0;
+        if (dt_ms > FLOW_MAX_DT_MS) dt_ms = FLOW_MAX_DT_MS;
+        s_flow_last_us = capturedUs;
+
+        portENTER_CRITICAL(&s_flow_lock);
+        FlowGrid& grid = s_flow[s_flow_active];
+        if (!s_flow_started_us[s_flow_active]) {
+            s_flow_started_us[s_flow_active] = capturedUs;
+        }
+        for (const auto& p : currentPedestrians) 
         {
-            bool isNew = true;
-            for (const auto& currPed : currentPedestrians) 
-            {
-                if (samePedestrian(newPed, currPed)) 
-                {
-                    isNew = false;
-                    break;
-                }
-            }
-            if (isNew) 
-            {
-                filteredPedestrians.push_back(newPed);
-            }
+            grid.occupy(p.centroidX, p.centroidY, (uint32_t)dt_ms);
+            grid.step(p.prevCentroidX, p.prevCentroidY, p.centroidX, p.centroidY);
         }
-
-        return filteredPedestrians;
+        portEXIT_CRITICAL(&s_flow_lock);
     }
 
 
@@ -318,37 +352,31 @@
     auto run_pedestrian_detect(uint8_t* image_data, int image_width, int image_height) -> std::vector<Pedestrian>
     {
         std::vector<Pedestrian> pedestrians;
-        //prep image
-        dl::image::img_t img{image_data, (uint16_t)image_width, (uint16_t)image_height, dl::image::DL_IMAGE_PIX_TYPE_RGB565};
+        std::vector<Detection> results;
 
-        //run model
-        auto& results = pmodel->run(img);
+        //run model, only boxes above the backend's threshold come back
+        g_detector->detect(image_data, image_width, image_height, results);
+        int64_t descriptorStarted = esp_timer_get_time();
         //parse results
         for (const auto& r : results) 
         {
-            if (r.score < pedestrianThreshold)
-            {
-            continue; //skip if not confident enough
-            } 
-            else
-            {
-                //ESP_LOGI(TAG, "Pedestrian detected with confidence: %.2f, box coords: x1:%d, y1:%d, x2:%d, y2:%d", 
-                //   r.score, r.box[0], r.box[1], r.box[2], r.box[3]);
-
-                //add to pedestrians list
-                Pedestrian p;
-                p.x1 = r.box[0];
-                p.y1 = r.box[1];
-                p.x2 = r.box[2];
-                p.y2 = r.box[3];
-                calculateCentroid(&p);
-                pedestrians.push_back(p);
-                
-
-                
-            }
-            
+            //ESP_LOGI(TAG, "Pedestrian detected with confidence: %.2f, box coords: x1:%d, y1:%d, x2:%d, y2:%d", 
+            //   r.score, r.x1, r.y1, r.x2, r.y2);
+
+            //add to pedestrians list
+            Pedestrian p;
+            p.x1 = r.x1;
+            p.y1 = r.y1;
+            p.x2 = r.x2;
+            p.y2 = r.y2;
+            calculateCentroid(&p);
+            p.prevCentroidX = p.centroidX;
+            p.prevCentroidY = p.centroidY;
+            p.trackId = 0;
+            computeAppearance(image_data, image_width, image_height, p.x1, p.y1, p.x2, p.y2, &p.appearance);
+            pedestrians.push_back(p);
         }
+        s_appearance_us += esp_timer_get_time() - descriptorStarted;
 
         return pedestrians;
     }
@@ -391,7 +419,7 @@
     //low-res raw frames for fast ML and overlay
     config.pixel_format = PIXFORMAT_RGB565; //fastest
     config.frame_size = FRAMESIZE_QQVGA;  //160x120
-    config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+    config.grab_mode = CAMERA_GRAB_WHEN_EMPTY; //switched to latest below when there are 2 buffers
 
     //not used for RGB565 or Grayscale capture, relevant only for PIXFORMAT_JPEG
     config.jpeg_quality = 40;
@@ -405,6 +433,8 @@
         ESP_LOGI(TAG, "PSRAM detected: %u bytes", (unsigned)ps_bytes);
         config.fb_location = CAMERA_FB_IN_PSRAM;
         config.fb_count = 2;
+        //driver keeps overwriting the free buffer, so fb_get hands out the newest frame not an old one
+        config.grab_mode = CAMERA_GRAB_LATEST;
     } 
     else 
     {
@@ -434,6 +464,70 @@
     }
 
 
+    //mount storage partition holding replay footage
+    static void storage_init(void)
+    {
+        //replay source and detector benchmark may both ask for it
+        static bool mounted = false;
+        if (mounted) {
+            return;
+        }
+        esp_vfs_spiffs_conf_t conf = {};
+        conf.base_path = "/storage";
+        conf.partition_label = "storage";
+        conf.max_files = 2;
+        conf.format_if_mount_failed = false;
+        esp_err_t err = esp_vfs_spiffs_register(&conf);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Storage mount failed: %s", esp_err_to_name(err));
+        }
+        mounted = err == ESP_OK;
+    }
+
+    //pick frame source from config, camera is the default
+    static FrameSource* create_frame_source(void)
+    {
+    #if FRAME_SOURCE == FRAME_SOURCE_REPLAY
+        storage_init();
+        ReplayFrameSource* replay = new ReplayFrameSource(REPLAY_PATH, REPLAY_FORMAT, FRAME_WIDTH, FRAME_HEIGHT, REPLAY_FPS, REPLAY_LOOP);
+        if (!replay->opened()) {
+            ESP_LOGE(TAG, "Replay source unavailable");
+            abort();
+        }
+        return replay;
+    #elif FRAME_SOURCE == FRAME_SOURCE_SYNTHETIC
+        SyntheticFrameSource* synthetic = new SyntheticFrameSource(FRAME_WIDTH, FRAME_HEIGHT, REPLAY_FPS, SYNTHETIC_BOXES);
+        if (!synthetic->ok()) {
+            ESP_LOGE(TAG, "Synthetic source unavailable");
+            abort();
+        }
+        return synthetic;
+    #else
+        camera_init_or_abort();
+        return new CameraFrameSource();
+    #endif
+    }
+
+    #if DETECTOR_BENCHMARK
+    //every detector backend over the replay file, wakes the creating task when done
+    static void detector_bench_task(void* pvParameters)
+    {
+        TaskHandle_t waiting = (TaskHandle_t)pvParameters;
+        storage_init();
+        {
+            ReplayFrameSource replay(REPLAY_PATH, REPLAY_FORMAT, FRAME_WIDTH, FRAME_HEIGHT, 0, false);
+            if (replay.opened()) {
+                s_bench_count = detector_benchmark(replay, DETECTOR_BENCH_TRUTH, s_bench, sizeof(s_bench) / sizeof(s_bench[0]), &s_bench_truth);
+            } else {
+                ESP_LOGE(TAG, "Detector benchmark needs %s", REPLAY_PATH);
+            }
+        }
+        xTaskNotifyGive(waiting);
+        vTaskDelete(NULL);
+    }
+    #endif
+
+
     //wifi event handler
     static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -518,7 +612,7 @@
     esp_err_t stream_handler(httpd_req_t *req)
     {
         
-        camera_fb_t *fb = NULL;
+        Frame fb = {};
         char part_buf[64];
         //set response headers and boundary for stream
         static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=123456789000000000000987654321";
@@ -533,24 +627,21 @@
         while (httpd_req_to_sockfd(req) >= 0) 
         {
             vTaskDelay(pdMS_TO_TICKS(100));
-            fb = esp_camera_fb_get();
-
-            if (!fb) {
+            if (!g_frame_source->get(fb)) {
                 ESP_LOGE(TAG, "Camera capture failed");
                 return ESP_FAIL;
             }
             
-            int width = fb->width;
-            int height = fb->height;
+            int width = fb.width;
+            int height = fb.height;
 
             //make a copy of the raw frame buffer 
-            std::vector<uint8_t> rgb_copy(fb->len);
-            memcpy(rgb_copy.data(), fb->buf, fb->len);
+            std::vector<uint8_t> rgb_copy(fb.len);
+            memcpy(rgb_copy.data(), fb.buf, fb.len);
             draw_line_rgb565(rgb_copy.data(), width, 0,255, 0);
 
             //free frame buffer to be reused
-            esp_camera_fb_return(fb);
-            fb = NULL;
+            g_frame_source->release(fb);
 
             auto results = run_pedestrian_detect(rgb_copy.data(), width, height);
             
@@ -561,11 +652,13 @@
             }
 
             //get filtered new pedestrians
-            auto newPedestrians = filterNewPedestrians(results);
+            auto newPedestrians = filterNewPedestrians(results, fb.captured_us);
             //clean up current pedestrians list and check for crossing the line
-            prunePedestrians(results);
+            prunePedestrians(results, fb.captured_us);
+            log_track_stats();
             //add new pedestrians to current list
             updatePedestrians(newPedestrians);
+            update_flow(fb.captured_us);
 
             //convert rgb565 to jpeg for streaming
             size_t jpg_buf_len = 0;
@@ -581,8 +674,6 @@
                 &jpg_buf_len          // output buffer length
             );
 
-            //esp_camera_fb_return(fb);
-            fb = NULL;
 
             if (!jpeg_converted) {
                 ESP_LOGE(TAG, "JPEG compression failed");
@@ -650,45 +741,140 @@
     }
 
 
+    //bucket a frame's capture to decision time
+    static void record_latency(int64_t captured_us)
+    {
+        uint32_t ms = (uint32_t)((esp_timer_get_time() - captured_us) / 1000);
+        size_t b = 0;
+        while (b < LATENCY_BUCKETS - 1 && ms > kLatencyEdgesMs[b]) b++;
+        s_latency_hist[b]++;
+        if (ms > s_latency_max_ms) {
+            s_latency_max_ms = ms;
+        }
+    }
+
+    //histogram since boot plus mailbox drops, as json fields
+    static size_t latency_json(char* buf, size_t len)
+    {
+        size_t used = 0;
+        int n = snprintf(buf, len, "\"latency_ms\":{\"le\":[");
+        for (size_t b = 0; n >= 0 && (size_t)n < len - used && b < LATENCY_BUCKETS - 1; b++) {
+            used += n;
+            n = snprintf(buf + used, len - used, "%s%u", b ? "," : "", (unsigned)kLatencyEdgesMs[b]);
+        }
+        for (size_t b = 0; n >= 0 && (size_t)n < len - used && b < LATENCY_BUCKETS; b++) {
+            used += n;
+            n = snprintf(buf + used, len - used, "%s%u", b ? "," : "],\"counts\":[", (unsigned)s_latency_hist[b]);
+        }
+        if (n < 0 || (size_t)n >= len - used) return 0;
+        used += n;
+        n = snprintf(buf + used, len - used, "],\"max\":%u},\"frames_posted\":%u,\"frames_dropped\":%u",
+                     (unsigned)s_latency_max_ms, (unsigned)camera_mailbox->posted(), (unsigned)camera_mailbox->dropped());
+        if (n < 0 || (size_t)n >= len - used) return 0;
+        return used + n;
+    }
+
+    static void log_latency()
+    {
+        char line[256];
+        if (latency_json(line, sizeof(line))) {
+            ESP_LOGI(TAG, "capture to decision: %s", line);
+        }
+    }
+
+
+    //swap flow grids and upload the finished one
+    static void send_flow(void)
+    {
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&s_flow_lock);
+        int done = s_flow_active;
+        s_flow_active ^= 1;
+        s_flow_started_us[s_flow_active] = 0;
+        portEXIT_CRITICAL(&s_flow_lock);
+
+        FlowGrid& grid = s_flow[done];
+        if (s_flow_started_us[done]) {
+            size_t cap = FlowGrid::json_capacity();
+            char* json = (char*)malloc(cap);
+            size_t len = json ? grid.to_json(json, cap, capture_unix_time(s_flow_started_us[done]), capture_unix_time(now_us)) : 0;
+            if (len) {
+                post_flow(json, len);
+            }
+            free(json);
+        }
+        grid.clear();
+    }
+
+
     //task report to api
     void report_task(void* pvParameters)
     {
         MovementEvent batch[REPORT_BATCH_MAX];
         TickType_t last = xTaskGetTickCount();
+        TickType_t last_flow = last;
         while (1) 
         {
+            if (xTaskGetTickCount() - last_flow >= pdMS_TO_TICKS(FLOW_REPORT_PERIOD_MS)) {
+                last_flow = xTaskGetTickCount();
+                send_flow();
+            }
+
             size_t count = 0;
             while (count < REPORT_BATCH_MAX && xQueueReceive(movement_queue, &batch[count], 0) == pdTRUE) {
                 count++;
-                printf("Queued movement event %d\n", count);
+                trace(TRACE_REPORT_QUEUED, (int32_t)count);
             }
             //send if we have any
             if (count > 0) {
-                printf("Reporting %d movement events\n", count);
+                trace(TRACE_REPORTING, (int32_t)count);
                 send_movements(batch, count);
             }
             else {
-                ESP_LOGI(TAG, "No movement events this cycle");
+                trace(TRACE_REPORT_IDLE);
             }
             vTaskDelayUntil(&last, pdMS_TO_TICKS(REPORT_PERIOD_MS));
+            //how late we woke up compared to the schedule, shows starvation by the pipeline
+            uint32_t late_ms = (uint32_t)((xTaskGetTickCount() - last) * portTICK_PERIOD_MS);
+            if (late_ms > s_report_late_max_ms) {
+                s_report_late_max_ms = late_ms;
+            }
         }
     }
     //task refactor
 
-    //task to capture images from camera and queue
+    //task to capture images from frame source and queue
     void camera_task(void* pvParameters)
     {
+        uint32_t frames = 0;
+        int64_t started = esp_timer_get_time();
         while (1) 
         {
-            camera_fb_t *fb = NULL;
-            fb = esp_camera_fb_get();
-            if (!fb) {
+            Frame fb = {};
+            if (!g_frame_source->get(fb)) {
+                //finite replay ran out, report throughput and stop producing
+                if (g_frame_source->finished()) {
+                    int64_t elapsed_us = esp_timer_get_time() - started;
+                    ESP_LOGI(TAG, "%s source finished: %u frames in %lld ms (%.1f fps)", g_frame_source->name(), (unsigned)frames, (long long)(elapsed_us / 1000), elapsed_us > 0 ? frames * 1e6 / elapsed_us : 0.0);
+                    vTaskDelete(NULL);
+                }
                 ESP_LOGE(TAG, "Camera capture failed");
                 continue;
             }
-            //send to queue
-            xQueueSend(camera_queue, &fb, portMAX_DELAY);  
-            vTaskDelay(pdMS_TO_TICKS(1));
+            //time blocked in the driver is not part of the slice
+            s_camera_budget.resumed();
+            frames++;
+            //hand to ml_task, a frame it has not picked up yet is stale now
+            Frame stale = {};
+            if (camera_mailbox->post(fb, stale)) {
+                g_frame_source->release(stale);
+            }
+        #if MAILBOX_LOSSLESS
+            //post() waited for ml_task to take the previous frame
+            s_camera_budget.resumed();
+        #endif
+            s_camera_budget.progress();
+            s_camera_budget.checkpoint();
 
         }
     }
@@ -697,97 +883,92 @@
     //ml task to run model and queue results
     void ml_task(void* pvParameters)
     {
-        static bool s_wdt_registered = false;
-        if (!s_wdt_registered) {
-                esp_err_t e = esp_task_wdt_add(NULL);
-                if (e == ESP_OK) {
-                    s_wdt_registered = true;
-                    ESP_LOGI(TAG, "ml_task registered with Task WDT");
-                } else {
-                    // If TWDT wasn't initialized for tasks, this will fail.
-                    // We just won't call esp_task_wdt_reset() in that case.
-                    ESP_LOGW(TAG, "ml_task WDT add failed: %s", esp_err_to_name(e));
-                }
-        }
+        //watchdog is fed per processed frame (or idle wait), not at fixed points
+        s_ml_budget.watchdog();
         while (1) 
         {
     
-            camera_fb_t *fb = NULL;
+            Frame fb = {};
             //wait for image from camera task
-            if (xQueueReceive(camera_queue, &fb, portMAX_DELAY) == pdTRUE) 
+            if (!camera_mailbox->take(fb, pdMS_TO_TICKS(ML_WAIT_MS))) 
             {
-                //received frame
-                if (fb) 
-                {
-                    int width = fb->width;
-                    int height = fb->height;
-        
-                    auto results = run_pedestrian_detect(fb->buf, width, height);
-                    //draw line
-                    draw_line_rgb565(fb->buf, width, 0,255, 0);
-                    vTaskDelay(pdMS_TO_TICKS(1));
-                    //draw centroids across each pedestrian detected
-                    for (auto &det : results) {
-                            draw_point_rgb565(fb->buf, width, height, det.centroidX, det.centroidY, 255, 0, 0);
-
-                    }
+                //nothing to do is not a hang (e.g. replay finished)
+                s_ml_budget.waiting();
+                continue;
+            }
+            s_ml_budget.resumed();
+            //received frame
+            if (fb.buf) 
+            {
+                int width = fb.width;
+                int height = fb.height;
+    
+                auto results = run_pedestrian_detect(fb.buf, width, height);
+                //draw line
+                draw_line_rgb565(fb.buf, width, 0,255, 0);
+                s_ml_budget.checkpoint();
+                //draw centroids across each pedestrian detected
+                for (auto &det : results) {
+                        draw_point_rgb565(fb.buf, width, height, det.centroidX, det.centroidY, 255, 0, 0);
 
-                    //get filtered new pedestrians
-                    auto newPedestrians = filterNewPedestrians(results);
-                    vTaskDelay(pdMS_TO_TICKS(1));
-                    //clean up current pedestrians list and check for crossing the line
-                    prunePedestrians(results);
-                                     
-                    vTaskDelay(pdMS_TO_TICKS(1));
-
-                    //add new pedestrians to current list
-                    updatePedestrians(newPedestrians);
-                       
-
-                    //convert rgb565 to jpeg for streaming
-                    size_t jpg_buf_len = 0;
-                    uint8_t *jpg_buf = NULL;
-                    vTaskDelay(pdMS_TO_TICKS(1));
-
-                    (void)esp_task_wdt_reset();
-                    bool jpeg_converted = fmt2jpg(
-                        fb->buf,
-                        fb->len, 
-                        fb->width, 
-                        fb->height,
-                        PIXFORMAT_RGB565,
-                        20, 
-                        &jpg_buf, 
-                        &jpg_buf_len    
-                    );
-
-                    esp_camera_fb_return(fb);
-                    fb = NULL;
-                  
-                    if (!jpeg_converted) {
-                        ESP_LOGE(TAG, "JPEG compression failed");
-                        vTaskDelay(pdMS_TO_TICKS(1));
-                        continue;
-                    }
+                }
 
-                  
-                    
-                    jpeg_frame frame = { .buf = jpg_buf, .len = jpg_buf_len };
-
-                    //send to stream queue
-                   //xQueueSend(stream_queue, &frame, portMAX_DELAY);   
-                     if (xQueueSend(stream_queue, &frame, 0) != pdPASS)
-                        {
-                            jpeg_frame stale;
-                            if (xQueueReceive(stream_queue, &stale, 0) == pdTRUE) {
-                                free(stale.buf);
-                            }
-                            (void)xQueueSend(stream_queue, &frame, 0);
-                      }
-
-                        (void)esp_task_wdt_reset();
-                        vTaskDelay(pdMS_TO_TICKS(1));
+                //get filtered new pedestrians
+                auto newPedestrians = filterNewPedestrians(results, fb.captured_us);
+                //clean up current pedestrians list and check for crossing the line
+                prunePedestrians(results, fb.captured_us);
+                log_track_stats();
+                //crossings for this frame are decided now
+                record_latency(fb.captured_us);
+
+                //add new pedestrians to current list
+                updatePedestrians(newPedestrians);
+                update_flow(fb.captured_us);
+                   
+
+                //convert rgb565 to jpeg for streaming
+                size_t jpg_buf_len = 0;
+                uint8_t *jpg_buf = NULL;
+                s_ml_budget.checkpoint();
+
+                bool jpeg_converted = fmt2jpg(
+                    fb.buf,
+                    fb.len, 
+                    fb.width, 
+                    fb.height,
+                    PIXFORMAT_RGB565,
+                    20, 
+                    &jpg_buf, 
+                    &jpg_buf_len    
+                );
+
+                g_frame_source->release(fb);
+              
+                if (!jpeg_converted) {
+                    ESP_LOGE(TAG, "JPEG compression failed");
+                    s_ml_budget.progress();
+                    continue;
                 }
+
+              
+                
+                jpeg_frame frame = { .buf = jpg_buf, .len = jpg_buf_len };
+
+                //send to stream queue
+               //xQueueSend(stream_queue, &frame, portMAX_DELAY);   
+                 if (xQueueSend(stream_queue, &frame, 0) != pdPASS)
+                    {
+                        jpeg_frame stale;
+                        if (xQueueReceive(stream_queue, &stale, 0) == pdTRUE) {
+                            free(stale.buf);
+                        }
+                        (void)xQueueSend(stream_queue, &frame, 0);
+                  }
+
+                    if (s_ml_budget.progress()) {
+                        log_latency();
+                    }
+                    s_ml_budget.checkpoint();
             }
         }
     }
@@ -835,6 +1016,119 @@
     }
 
 
+    //scheduler stats, also a cheap probe of httpd responsiveness (time the request)
+    static esp_err_t stats_handler(httpd_req_t* req)
+    {
+        char body[1024];
+        char latency[256];
+        const TaskBudget* tasks[] = {&s_camera_budget, &s_ml_budget};
+        size_t len = latency_json(latency, sizeof(latency)) ? task_budget_json(body, sizeof(body), tasks, 2, s_report_late_max_ms, latency) : 0;
+        if (!len) {
+            return httpd_resp_send_500(req);
+        }
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_send(req, body, len);
+    }
+
+
+    //trace rings as a binary dump (decode with tools/trace_decode.py)
+    static esp_err_t trace_handler(httpd_req_t* req)
+    {
+        size_t cap = trace_dump_capacity();
+        uint8_t* dump = (uint8_t*)malloc(cap);
+        size_t len = dump ? trace_dump(dump, cap) : 0;
+        if (!len) {
+            free(dump);
+            return httpd_resp_send_500(req);
+        }
+        httpd_resp_set_type(req, "application/octet-stream");
+        esp_err_t res = httpd_resp_send(req, (const char*)dump, len);
+        free(dump);
+        return res;
+    }
+
+    //same records formatted on the device, for a quick look from a browser
+    static esp_err_t trace_text_handler(httpd_req_t* req)
+    {
+        size_t cap = trace_dump_capacity();
+        uint8_t* dump = (uint8_t*)malloc(cap);
+        size_t len = dump ? trace_dump(dump, cap) : 0;
+        if (!len) {
+            free(dump);
+            return httpd_resp_send_500(req);
+        }
+        httpd_resp_set_type(req, "text/plain");
+        const TraceDumpHeader* header = (const TraceDumpHeader*)dump;
+        const TraceRecord* records = (const TraceRecord*)(dump + sizeof(TraceDumpHeader));
+        char line[160];
+        esp_err_t res = ESP_OK;
+        for (uint32_t i = 0; i < header->count && res == ESP_OK; i++) {
+            int n = trace_format(records[i], line, sizeof(line) - 1);
+            if (n < 0) continue;
+            if ((size_t)n > sizeof(line) - 2) n = sizeof(line) - 2;
+            line[n++] = '\n';
+            res = httpd_resp_send_chunk(req, line, n);
+        }
+        free(dump);
+        if (res == ESP_OK) {
+            res = httpd_resp_send_chunk(req, NULL, 0);
+        }
+        return res;
+    }
+
+
+    //detector backends and the last benchmark, POST a backend name to use it from the next boot
+    static esp_err_t detector_handler(httpd_req_t* req)
+    {
+        if (req->method == HTTP_POST) {
+            char name[32] = {};
+            int got = httpd_req_recv(req, name, sizeof(name) - 1);
+            while (got > 0 && (name[got - 1] == '\n' || name[got - 1] == '\r' || name[got - 1] == ' ')) {
+                name[--got] = '\0';
+            }
+            if (got <= 0 || detector_configure(name) != ESP_OK) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "unknown detector backend");
+            }
+            ESP_LOGI(TAG, "Detector backend %s stored, restart to apply", name);
+        }
+
+        size_t cap = 3072;
+        char* body = (char*)malloc(cap);
+        if (!body) {
+            return httpd_resp_send_500(req);
+        }
+        int n = snprintf(body, cap, "{\"active\":\"%s\",\"configured\":\"%s\",\"available\":[", g_detector->name(), detector_configured());
+        size_t used = (n > 0 && (size_t)n < cap) ? n : cap;
+        for (size_t i = 0; i < detector_count() && used < cap; i++) {
+            n = snprintf(body + used, cap - used, "%s\"%s\"", i ? "," : "", detector_name(i));
+            used = (n > 0 && (size_t)n < cap - used) ? used + n : cap;
+        }
+        if (used < cap) {
+            n = snprintf(body + used, cap - used, "],\"benchmark\":");
+            used = (n > 0 && (size_t)n < cap - used) ? used + n : cap;
+        }
+        if (used < cap && s_bench_count) {
+            size_t len = detector_bench_json(body + used, cap - used, s_bench, s_bench_count, s_bench_truth);
+            used = len ? used + len : cap;
+        } else if (used < cap) {
+            n = snprintf(body + used, cap - used, "null");
+            used = (n > 0 && (size_t)n < cap - used) ? used + n : cap;
+        }
+        if (used < cap) {
+            n = snprintf(body + used, cap - used, "}");
+            used = (n > 0 && (size_t)n < cap - used) ? used + n : cap;
+        }
+        if (used >= cap) {
+            free(body);
+            return httpd_resp_send_500(req);
+        }
+        httpd_resp_set_type(req, "application/json");
+        esp_err_t res = httpd_resp_send(req, body, used);
+        free(body);
+        return res;
+    }
+
+
     httpd_handle_t start_webserver_pipeline(void)
     {
         httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -859,8 +1153,36 @@
                         .user_ctx = nullptr};
 
 
+            httpd_uri_t stats = {.uri = "/stats",
+                        .method = HTTP_GET,
+                        .handler = stats_handler,
+                        .user_ctx = nullptr};
+
+
             httpd_register_uri_handler(server, &root);
             httpd_register_uri_handler(server, &stream_uri);
+            httpd_uri_t trace_dump_uri = {.uri = "/trace",
+                        .method = HTTP_GET,
+                        .handler = trace_handler,
+                        .user_ctx = nullptr};
+
+            httpd_uri_t trace_text_uri = {.uri = "/trace.txt",
+                        .method = HTTP_GET,
+                        .handler = trace_text_handler,
+                        .user_ctx = nullptr};
+
+
+            httpd_register_uri_handler(server, &stats);
+            httpd_register_uri_handler(server, &trace_dump_uri);
+            httpd_register_uri_handler(server, &trace_text_uri);
+
+            httpd_uri_t detector_uri = {.uri = "/detector",
+                        .method = HTTP_GET,
+                        .handler = detector_handler,
+                        .user_ctx = nullptr};
+            httpd_register_uri_handler(server, &detector_uri);
+            detector_uri.method = HTTP_POST;
+            httpd_register_uri_handler(server, &detector_uri);
         }
         return server;
     }
@@ -885,14 +1207,32 @@
         vTaskDelay(pdMS_TO_TICKS(2000));  
         //sync time for unix timestamps
         init_sntp();
-        //start cam
-        camera_init_or_abort();    
-        pmodel = new PedestrianDetect();
+    #if DETECTOR_BENCHMARK
+        //same stack and core as ml_task, wait for it before the pipeline competes for cpu and memory
+        xTaskCreatePinnedToCore(&detector_bench_task, "detector_bench", 16384, xTaskGetCurrentTaskHandle(), 6, NULL, 1);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    #endif
+        //start cam or the replay/synthetic stand in
+        g_frame_source = create_frame_source();
+    #if FRAME_SOURCE == FRAME_SOURCE_SYNTHETIC
+        g_detector = create_detector(SYNTHETIC_DETECTOR[0] ? SYNTHETIC_DETECTOR : detector_configured());
+    #else
+        g_detector = create_detector(detector_configured());
+    #endif
+        ESP_LOGI(TAG, "Detector backend: %s", g_detector->name());
         //create tasks
-        camera_queue = xQueueCreate(5, sizeof(camera_fb_t*));
+        camera_mailbox = new FrameMailbox(MAILBOX_LOSSLESS);
+        init_flow(FRAME_WIDTH, FRAME_HEIGHT);
+        tracker_set_crossing_handler(record_movement);
         stream_queue = xQueueCreate(1, sizeof(jpeg_frame));
         movement_queue = xQueueCreate(32, sizeof(MovementEvent));
 
+        task_budget_init();
+    #if TRACE_MEASURE_AT_BOOT
+        trace_measure();
+    #endif
+        xTaskCreate(&trace_task, "trace_task", 3072, (void*)(intptr_t)TRACE_DRAIN_MS, TRACE_TASK_PRIORITY, NULL);
+
         xTaskCreatePinnedToCore(&camera_task, "camera_task", 4096, NULL, 7, NULL, 0);
 	    xTaskCreatePinnedToCore(&ml_task, "ml_task", 16384, NULL, 6, NULL, 1);
         xTaskCreatePinnedToCore(&report_task, "report_task", 4096, NULL, 6, NULL, 0);
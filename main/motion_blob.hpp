@@ -0,0 +1,208 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+//moving regions on a coarse luma grid, the motion detector backend (detector.cpp) without esp-idf
+//so tools/motion_ghost_test.cpp can run it on the host
+//a cell moves when it differs from a running background; a blob none of whose cells changed for a
+//while (someone who stood there and left, or stands there now) is taken into the background
+
+class MotionBlob {
+public:
+    static const int MAX_COLS = 40;
+    static const int MAX_ROWS = 30;
+    static const int MAX_CELLS = MAX_COLS * MAX_ROWS;
+    static const int MIN_CELL = 8;        //pixels per cell side, doubled for frames wider than 320
+    static const int DIFF = 20;           //luma change (0..255) from the background that marks a cell as moving
+    static const int MIN_CELLS = 4;       //smaller blobs are noise
+    static const int LEARN_STILL = 3;     //background follows still cells at 1/8 per frame
+    static const int LEARN_MOVING = 6;    //and moving ones at 1/64
+    static const int STABLE_DIFF = 6;     //luma change from the previous frame below which a cell is not changing
+    static const int STABLE_FRAMES = 20;  //blobs not changing anywhere for this long become background
+    static const int STABLE_CELL_FRAMES = 80; //and single cells, even in a blob someone is walking through
+
+    //box in frame pixels (x2/y2 exclusive), fill = share of it that is moving
+    struct Box {
+        int x1;
+        int y1;
+        int x2;
+        int y2;
+        float fill;
+    };
+
+    //RGB565 frame (camera byte order), out is replaced with blobs filling at least min_fill of their box
+    void detect(const uint8_t* rgb565, int width, int height, float min_fill, std::vector<Box>& out)
+    {
+        out.clear();
+        if (width != frame_width || height != frame_height) {
+            resize(width, height);
+        }
+        measure(rgb565);
+        int cells = cols * rows;
+
+        if (!primed) {
+            relearn();
+            primed = true;
+            return;
+        }
+
+        int moving_cells = 0;
+        for (int i = 0; i < cells; i++) {
+            int diff = luma[i] - (background[i] >> 4);
+            moving[i] = (diff >= DIFF || diff <= -DIFF) ? 1 : 0;
+            moving_cells += moving[i];
+        }
+        //most of the frame changed at once: exposure or lighting, not people
+        if (moving_cells * 2 > cells) {
+            relearn();
+            return;
+        }
+
+        //frames each moving cell has looked the same, blob() decides on whole blobs since the
+        //inside of someone walking in plain clothes does not change either, only their edges do
+        //a single cell goes on its own only after longer than anyone takes to walk over it
+        for (int i = 0; i < cells; i++) {
+            int change = luma[i] - previous[i];
+            if (!moving[i] || change > STABLE_DIFF || change < -STABLE_DIFF) {
+                stable[i] = 0;
+            } else if (++stable[i] >= STABLE_CELL_FRAMES) {
+                background[i] = (uint16_t)(luma[i] << 4);
+                moving[i] = 0;
+                stable[i] = 0;
+            }
+        }
+        memcpy(previous, luma, cells);
+
+        for (int i = 0; i < cells; i++) {
+            if (moving[i] == 1) {
+                blob(i, min_fill, out);
+            }
+        }
+
+        for (int i = 0; i < cells; i++) {
+            int diff = ((int)luma[i] << 4) - background[i];
+            background[i] += diff / (1 << (moving[i] ? LEARN_MOVING : LEARN_STILL));
+        }
+    }
+
+    //bytes of state, whatever the frame size
+    static size_t state_bytes() { return sizeof(MotionBlob); }
+
+private:
+    void resize(int width, int height)
+    {
+        frame_width = width;
+        frame_height = height;
+        cell = MIN_CELL;
+        while ((width + cell - 1) / cell > MAX_COLS || (height + cell - 1) / cell > MAX_ROWS) {
+            cell *= 2;
+        }
+        cols = (width + cell - 1) / cell;
+        rows = (height + cell - 1) / cell;
+        primed = false;
+    }
+
+    //mean luma per cell, every other pixel and row
+    void measure(const uint8_t* frame)
+    {
+        for (int cy = 0; cy < rows; cy++) {
+            int y_end = (cy + 1) * cell < frame_height ? (cy + 1) * cell : frame_height;
+            for (int cx = 0; cx < cols; cx++) {
+                int x_end = (cx + 1) * cell < frame_width ? (cx + 1) * cell : frame_width;
+                uint32_t sum = 0;
+                uint32_t n = 0;
+                for (int y = cy * cell; y < y_end; y += 2) {
+                    const uint8_t* px = frame + ((size_t)y * frame_width + cx * cell) * 2;
+                    for (int x = cx * cell; x < x_end; x += 2, px += 4) {
+                        //hi = RRRRRGGG, lo = GGGBBBBB, weights 77/150/29 scaled to 8 bit channels
+                        uint8_t hi = px[0];
+                        uint8_t lo = px[1];
+                        uint32_t r = hi >> 3;
+                        uint32_t g = ((hi & 7) << 3) | (lo >> 5);
+                        uint32_t b = lo & 31;
+                        sum += (r * 8 * 77 + g * 4 * 150 + b * 8 * 29) >> 8;
+                        n++;
+                    }
+                }
+                luma[cy * cols + cx] = (uint8_t)(n ? sum / n : 0);
+            }
+        }
+    }
+
+    void relearn()
+    {
+        for (int i = 0; i < cols * rows; i++) {
+            background[i] = (uint16_t)(luma[i] << 4);
+        }
+        memcpy(previous, luma, cols * rows);
+        memset(stable, 0, sizeof(stable));
+    }
+
+    //collect the moving cells connected to start (4-neighbourhood) into one box
+    void blob(int start, float min_fill, std::vector<Box>& out)
+    {
+        int top = 0;
+        int count = 0;
+        int still = STABLE_CELL_FRAMES;
+        int cx0 = cols, cy0 = rows, cx1 = 0, cy1 = 0;
+        stack[top++] = (uint16_t)start;
+        moving[start] = 3;
+        while (top) {
+            int i = stack[--top];
+            int cx = i % cols;
+            int cy = i / cols;
+            count++;
+            if (stable[i] < still) still = stable[i];
+            if (cx < cx0) cx0 = cx;
+            if (cy < cy0) cy0 = cy;
+            if (cx > cx1) cx1 = cx;
+            if (cy > cy1) cy1 = cy;
+            //each cell is pushed once (marked 3 on push), so the stack never holds more than MAX_CELLS
+            if (cx > 0 && moving[i - 1] == 1) { moving[i - 1] = 3; stack[top++] = (uint16_t)(i - 1); }
+            if (cx < cols - 1 && moving[i + 1] == 1) { moving[i + 1] = 3; stack[top++] = (uint16_t)(i + 1); }
+            if (cy > 0 && moving[i - cols] == 1) { moving[i - cols] = 3; stack[top++] = (uint16_t)(i - cols); }
+            if (cy < rows - 1 && moving[i + cols] == 1) { moving[i + cols] = 3; stack[top++] = (uint16_t)(i + cols); }
+        }
+
+        //nothing in the blob changed for STABLE_FRAMES: what is there now is background
+        //(clears the ghost a person leaves behind after standing, instead of fading it at 1/64)
+        bool learn = still >= STABLE_FRAMES;
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int i = cy * cols + cx0; i <= cy * cols + cx1; i++) {
+                if (moving[i] != 3) continue;
+                moving[i] = learn ? 0 : 2;
+                if (learn) {
+                    background[i] = (uint16_t)(luma[i] << 4);
+                    stable[i] = 0;
+                }
+            }
+        }
+        if (learn || count < MIN_CELLS) {
+            return;
+        }
+
+        float fill = (float)count / ((cx1 - cx0 + 1) * (cy1 - cy0 + 1));
+        if (fill < min_fill) {
+            return;
+        }
+        int x2 = (cx1 + 1) * cell;
+        int y2 = (cy1 + 1) * cell;
+        out.push_back({cx0 * cell, cy0 * cell, x2 < frame_width ? x2 : frame_width, y2 < frame_height ? y2 : frame_height, fill});
+    }
+
+    int frame_width = 0;
+    int frame_height = 0;
+    int cell = MIN_CELL;
+    int cols = 0;
+    int rows = 0;
+    bool primed = false;
+    uint16_t background[MAX_CELLS]; //luma << 4 so slow learning rates do not round away
+    uint8_t luma[MAX_CELLS];
+    uint8_t previous[MAX_CELLS];    //luma of the last frame
+    uint8_t stable[MAX_CELLS];      //frames a moving cell has not changed
+    uint8_t moving[MAX_CELLS];      //0 still, 1 moving, 2 moving and already in a blob, 3 in the blob being collected
+    uint16_t stack[MAX_CELLS];
+};
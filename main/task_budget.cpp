@@ -0,0 +1,182 @@
+#include "task_budget.hpp"
+
+#include <stdio.h>
+#include "esp_freertos_hooks.h"
+#include "esp_log.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+
+static const char* TAG = "task_budget";
+
+//last time each core's idle task ran, written from the idle hook
+static volatile int64_t s_idle_seen_us[2] = {0, 0};
+static bool s_idle_tracked = false;
+
+static bool idle_hook_core0()
+{
+    s_idle_seen_us[0] = esp_timer_get_time();
+    return true;
+}
+
+static bool idle_hook_core1()
+{
+    s_idle_seen_us[1] = esp_timer_get_time();
+    return true;
+}
+
+void task_budget_init()
+{
+    int64_t now = esp_timer_get_time();
+    s_idle_seen_us[0] = now;
+    s_idle_seen_us[1] = now;
+    bool ok = esp_register_freertos_idle_hook_for_cpu(idle_hook_core0, 0) == ESP_OK;
+    ok = esp_register_freertos_idle_hook_for_cpu(idle_hook_core1, 1) == ESP_OK && ok;
+    s_idle_tracked = ok;
+    if (!ok) {
+        ESP_LOGW(TAG, "idle hooks unavailable, yielding on budget only");
+    }
+}
+
+int64_t task_budget_idle_gap_us(int core)
+{
+    if (!s_idle_tracked || core < 0 || core > 1) {
+        return 0;
+    }
+    return esp_timer_get_time() - s_idle_seen_us[core];
+}
+
+
+TaskBudget::TaskBudget(const char* name, int64_t budget_us, int64_t starve_us, int64_t stats_period_us)
+    : task_name(name), budget_us(budget_us), starve_us(starve_us), stats_period_us(stats_period_us)
+{
+}
+
+void TaskBudget::watchdog()
+{
+    esp_err_t e = esp_task_wdt_add(NULL);
+    if (e == ESP_OK) {
+        wdt = true;
+        ESP_LOGI(TAG, "%s registered with Task WDT", task_name);
+    } else {
+        //TWDT not initialized for tasks, run without it
+        ESP_LOGW(TAG, "%s WDT add failed: %s", task_name, esp_err_to_name(e));
+    }
+}
+
+void TaskBudget::feed()
+{
+    if (wdt) {
+        (void)esp_task_wdt_reset();
+    }
+}
+
+void TaskBudget::note_slice(int64_t now)
+{
+    if (slice_start && now - slice_start > max_slice_us) {
+        max_slice_us = now - slice_start;
+    }
+}
+
+void TaskBudget::resumed()
+{
+    int64_t now = esp_timer_get_time();
+    core = xPortGetCoreID();
+    slice_start = now;
+    if (!window_start) {
+        window_start = now;
+    }
+}
+
+void TaskBudget::checkpoint()
+{
+    int64_t now = esp_timer_get_time();
+    if (!slice_start) {
+        resumed();
+        return;
+    }
+
+    int64_t gap = task_budget_idle_gap_us(core);
+    if (gap > max_idle_gap_us) {
+        max_idle_gap_us = gap;
+    }
+    if (now - slice_start < budget_us && gap < starve_us) {
+        return;
+    }
+
+    //one tick is the shortest sleep that lets lower priority tasks in
+    note_slice(now);
+    vTaskDelay(1);
+    int64_t woke = esp_timer_get_time();
+    yields++;
+    yield_us += woke - now;
+    slice_start = woke;
+}
+
+bool TaskBudget::progress()
+{
+    int64_t now = esp_timer_get_time();
+    feed();
+    frames++;
+    return roll(now);
+}
+
+void TaskBudget::waiting()
+{
+    feed();
+    roll(esp_timer_get_time());
+}
+
+bool TaskBudget::roll(int64_t now)
+{
+    if (!window_start || now - window_start < stats_period_us) {
+        return false;
+    }
+    note_slice(now);
+
+    int64_t window = now - window_start;
+    last.window_ms = (uint32_t)(window / 1000);
+    last.frames = frames;
+    last.fps_x10 = (uint32_t)(frames * 10000000LL / window);
+    last.yields = yields;
+    last.yield_ms = (uint32_t)(yield_us / 1000);
+    last.max_slice_ms = (uint32_t)(max_slice_us / 1000);
+    last.max_idle_gap_ms = (uint32_t)(max_idle_gap_us / 1000);
+
+    ESP_LOGI(TAG, "%s: %u.%u fps, %u yields (%u ms), longest slice %u ms, idle gap core%d %u ms",
+             task_name, (unsigned)(last.fps_x10 / 10), (unsigned)(last.fps_x10 % 10), (unsigned)last.yields,
+             (unsigned)last.yield_ms, (unsigned)last.max_slice_ms, core, (unsigned)last.max_idle_gap_ms);
+
+    window_start = now;
+    frames = 0;
+    yields = 0;
+    yield_us = 0;
+    max_slice_us = 0;
+    max_idle_gap_us = 0;
+    return true;
+}
+
+
+size_t task_budget_json(char* buf, size_t len, const TaskBudget* const* tasks, size_t count, uint32_t report_late_max_ms, const char* extra)
+{
+    size_t used = 0;
+    int n = snprintf(buf, len, "{\"tasks\":{");
+    if (n < 0 || (size_t)n >= len) return 0;
+    used = n;
+
+    for (size_t i = 0; i < count; i++) {
+        const TaskBudgetStats& s = tasks[i]->stats();
+        n = snprintf(buf + used, len - used,
+                     "%s\"%s\":{\"window_ms\":%u,\"frames\":%u,\"fps\":%u.%u,\"yields\":%u,\"yield_ms\":%u,\"max_slice_ms\":%u,\"max_idle_gap_ms\":%u}",
+                     i ? "," : "", tasks[i]->name(), (unsigned)s.window_ms, (unsigned)s.frames,
+                     (unsigned)(s.fps_x10 / 10), (unsigned)(s.fps_x10 % 10), (unsigned)s.yields, (unsigned)s.yield_ms,
+                     (unsigned)s.max_slice_ms, (unsigned)s.max_idle_gap_ms);
+        if (n < 0 || (size_t)n >= len - used) return 0;
+        used += n;
+    }
+
+    n = snprintf(buf + used, len - used, "},\"idle_gap_ms\":[%u,%u],\"report_late_max_ms\":%u%s%s}",
+                 (unsigned)(task_budget_idle_gap_us(0) / 1000), (unsigned)(task_budget_idle_gap_us(1) / 1000),
+                 (unsigned)report_late_max_ms, (extra && *extra) ? "," : "", extra ? extra : "");
+    if (n < 0 || (size_t)n >= len - used) return 0;
+    return used + n;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+//cooperative scheduling for the pipeline tasks
+//a task calls checkpoint() between stages, which only sleeps (one tick) when
+//- the task ran longer than its budget since it last blocked, or
+//- the idle task of its core has not run for starve_us, i.e. every lower priority task on that core is starved
+//with CONFIG_FREERTOS_HZ=100 any sleep costs a whole 10 ms tick, so not sleeping is the common case
+
+//stats of the last finished window, 32 bit fields so readers on another core never see torn values
+struct TaskBudgetStats {
+    uint32_t window_ms;
+    uint32_t frames;
+    uint32_t fps_x10;
+    uint32_t yields;        //sleeps taken by checkpoint()
+    uint32_t yield_ms;      //time spent in those sleeps
+    uint32_t max_slice_ms;  //longest run without blocking or yielding
+    uint32_t max_idle_gap_ms; //longest the idle task of this core went without running
+};
+
+class TaskBudget {
+public:
+    TaskBudget(const char* name, int64_t budget_us, int64_t starve_us, int64_t stats_period_us);
+
+    //add the calling task to the task watchdog, progress()/waiting() feed it from then on
+    void watchdog();
+
+    //task just returned from a blocking wait (queue, camera), starts a new slice
+    void resumed();
+
+    //between stages: yield if over budget or lower priority work is starved
+    void checkpoint();
+
+    //one frame fully processed: feed watchdog, count it and roll the stats window
+    //true when a window just closed (time to log other per window stats)
+    bool progress();
+
+    //blocking wait timed out with nothing to do, the task is healthy so feed the watchdog
+    void waiting();
+
+    const char* name() const { return task_name; }
+    const TaskBudgetStats& stats() const { return last; }
+
+private:
+    void feed();
+    void note_slice(int64_t now);
+    bool roll(int64_t now);
+
+    const char* task_name;
+    int64_t budget_us;
+    int64_t starve_us;
+    int64_t stats_period_us;
+    bool wdt = false;
+    int core = 0;
+
+    int64_t slice_start = 0;
+    int64_t window_start = 0;
+    uint32_t frames = 0;
+    uint32_t yields = 0;
+    int64_t yield_us = 0;
+    int64_t max_slice_us = 0;
+    int64_t max_idle_gap_us = 0;
+
+    TaskBudgetStats last = {};
+};
+
+//start watching the idle tasks, call once from app_main before the pipeline tasks start
+void task_budget_init();
+
+//microseconds since the idle task of core last ran, 0 if not tracked
+int64_t task_budget_idle_gap_us(int core);
+
+//format tasks' stats as a json object into buf, extra (already formatted "key":value fields) is appended
+//returns bytes written, 0 if buf is too small
+size_t task_budget_json(char* buf, size_t len, const TaskBudget* const* tasks, size_t count, uint32_t report_late_max_ms, const char* extra);
@@ -0,0 +1,184 @@
+#include "trace.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "trace";
+
+static const char* const kFormats[] = {
+#define TRACE_FORMAT(id, fmt) fmt,
+#include "trace_formats.h"
+#undef TRACE_FORMAT
+};
+static_assert(sizeof(kFormats) / sizeof(kFormats[0]) == TRACE_ID_COUNT, "format table out of sync");
+
+static const uint32_t RING_MASK = TRACE_RING_RECORDS - 1;
+static_assert((TRACE_RING_RECORDS & (TRACE_RING_RECORDS - 1)) == 0, "ring size must be a power of two");
+
+//writers reserve a slot with one atomic add, so tasks preempting each other (or an unpinned task
+//moving cores) never block or corrupt a record; a slot is readable once seq is set
+struct TraceRing {
+    uint32_t head; //next sequence to hand out
+    TraceRecord records[TRACE_RING_RECORDS];
+};
+
+static TraceRing s_rings[portNUM_PROCESSORS];
+static uint32_t s_drained[portNUM_PROCESSORS]; //next sequence trace_task prints, per ring
+static volatile uint32_t s_lost = 0;
+
+void trace_write(TraceId id, int nargs, int32_t a0, int32_t a1, int32_t a2, int32_t a3)
+{
+    int core = xPortGetCoreID();
+    TraceRing& ring = s_rings[core];
+    uint32_t seq = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+    TraceRecord& r = ring.records[seq & RING_MASK];
+
+    __atomic_store_n(&r.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r.time_us = esp_timer_get_time();
+    r.id = id;
+    r.nargs = (uint8_t)nargs;
+    r.core = (uint8_t)core;
+    r.args[0] = a0;
+    r.args[1] = a1;
+    r.args[2] = a2;
+    r.args[3] = a3;
+    __atomic_store_n(&r.seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+//copy record `seq` of a ring: 1 = copied, 0 = not written yet, -1 = already overwritten
+static int read_record(const TraceRing& ring, uint32_t seq, TraceRecord& out)
+{
+    const TraceRecord& r = ring.records[seq & RING_MASK];
+    uint32_t committed = __atomic_load_n(&r.seq, __ATOMIC_ACQUIRE);
+    if (committed != seq + 1) {
+        return (committed == 0 || committed < seq + 1) ? 0 : -1;
+    }
+    memcpy(&out, &r, sizeof(out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    //a writer lapping the ring during the copy changes seq
+    return __atomic_load_n(&r.seq, __ATOMIC_RELAXED) == seq + 1 ? 1 : -1;
+}
+
+int trace_format(const TraceRecord& r, char* buf, size_t len)
+{
+    int n = snprintf(buf, len, "[%lld.%06lld c%u] ", (long long)(r.time_us / 1000000), (long long)(r.time_us % 1000000), (unsigned)r.core);
+    if (n < 0 || (size_t)n >= len) return n;
+    if (r.id >= TRACE_ID_COUNT) {
+        return n + snprintf(buf + n, len - n, "unknown trace id %u", (unsigned)r.id);
+    }
+    return n + snprintf(buf + n, len - n, kFormats[r.id], r.args[0], r.args[1], r.args[2], r.args[3]);
+}
+
+size_t trace_drain_to_uart()
+{
+    char line[160];
+    size_t printed = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TraceRing& ring = s_rings[core];
+        uint32_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+        uint32_t& next = s_drained[core];
+        if (head - next > (uint32_t)TRACE_RING_RECORDS) {
+            s_lost += head - TRACE_RING_RECORDS - next;
+            next = head - TRACE_RING_RECORDS;
+        }
+        while (next != head) {
+            TraceRecord r;
+            int got = read_record(ring, next, r);
+            if (got == 0) break; //writer still busy, pick it up next time
+            if (got > 0) {
+                trace_format(r, line, sizeof(line));
+                printf("%s\n", line);
+                printed++;
+            } else {
+                s_lost++;
+            }
+            next++;
+        }
+    }
+    return printed;
+}
+
+size_t trace_dump_capacity()
+{
+    return sizeof(TraceDumpHeader) + sizeof(TraceRecord) * TRACE_RING_RECORDS * portNUM_PROCESSORS;
+}
+
+size_t trace_dump(uint8_t* buf, size_t len)
+{
+    if (len < trace_dump_capacity()) return 0;
+
+    TraceDumpHeader header = {};
+    memcpy(header.magic, "TRC1", 4);
+    header.record_size = sizeof(TraceRecord);
+    header.format_count = TRACE_ID_COUNT;
+
+    uint8_t* out = buf + sizeof(header);
+    uint32_t count = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const TraceRing& ring = s_rings[core];
+        uint32_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+        uint32_t first = head > (uint32_t)TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+        for (uint32_t seq = first; seq != head; seq++) {
+            TraceRecord r;
+            if (read_record(ring, seq, r) > 0) {
+                memcpy(out, &r, sizeof(r));
+                out += sizeof(r);
+                count++;
+            }
+        }
+    }
+    header.count = count;
+    header.lost = s_lost;
+    memcpy(buf, &header, sizeof(header));
+    return out - buf;
+}
+
+uint32_t trace_lost()
+{
+    return s_lost;
+}
+
+void trace_task(void* pvParameters)
+{
+    TickType_t period = pdMS_TO_TICKS((intptr_t)pvParameters);
+    if (period == 0) period = 1;
+    uint32_t reported_lost = 0;
+    while (1) {
+        trace_drain_to_uart();
+        if (s_lost != reported_lost) {
+            reported_lost = s_lost;
+            ESP_LOGW(TAG, "%u trace records lost (ring full)", (unsigned)reported_lost);
+        }
+        vTaskDelay(period);
+    }
+}
+
+void trace_measure()
+{
+    const int calls = 1000;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < calls; i++) {
+        trace(TRACE_SELF_TEST, i, i * 2, i * 3);
+    }
+    int64_t trace_ns = (esp_timer_get_time() - t0) * 1000 / calls;
+
+    //what the same message costs when formatted and printed synchronously
+    const int lines = 10;
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < lines; i++) {
+        ESP_LOGI(TAG, "trace self test %d %d %d", i, i * 2, i * 3);
+    }
+    int64_t log_ns = (esp_timer_get_time() - t0) * 1000 / lines;
+
+    //forget the test records so trace_task does not print them
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_drained[core] = __atomic_load_n(&s_rings[core].head, __ATOMIC_ACQUIRE);
+    }
+    ESP_LOGI(TAG, "trace() %lld ns/call, ESP_LOGI %lld ns/call (%lldx)", (long long)trace_ns, (long long)log_ns,
+             (long long)(trace_ns > 0 ? log_ns / trace_ns : 0));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//deferred logging for the hot path
+//a trace call stores a 32 byte binary record (message id + up to 4 ints) in a ring per core,
+//nothing is formatted or printed by the caller; trace_task (low priority) prints them later
+//and /trace serves the rings as a binary dump for tools/trace_decode.py
+
+enum TraceId : uint16_t {
+#define TRACE_FORMAT(id, fmt) id,
+#include "trace_formats.h"
+#undef TRACE_FORMAT
+    TRACE_ID_COUNT
+};
+
+static const int TRACE_MAX_ARGS = 4;
+static const int TRACE_RING_RECORDS = 128; //per core, power of two
+
+struct TraceRecord {
+    int64_t time_us;  //esp_timer time
+    uint32_t seq;     //slot sequence + 1 once fully written, 0 while being written
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t core;
+    int32_t args[TRACE_MAX_ARGS];
+};
+static_assert(sizeof(TraceRecord) == 32, "dump format expects 32 byte records");
+
+//dump header, followed by `count` TraceRecords (little endian, as in memory)
+struct TraceDumpHeader {
+    char magic[4];  //"TRC1"
+    uint16_t record_size;
+    uint16_t format_count;
+    uint32_t count;
+    uint32_t lost;  //records overwritten before trace_task got to them
+};
+
+void trace_write(TraceId id, int nargs, int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+
+inline void trace(TraceId id) { trace_write(id, 0, 0, 0, 0, 0); }
+inline void trace(TraceId id, int32_t a0) { trace_write(id, 1, a0, 0, 0, 0); }
+inline void trace(TraceId id, int32_t a0, int32_t a1) { trace_write(id, 2, a0, a1, 0, 0); }
+inline void trace(TraceId id, int32_t a0, int32_t a1, int32_t a2) { trace_write(id, 3, a0, a1, a2, 0); }
+inline void trace(TraceId id, int32_t a0, int32_t a1, int32_t a2, int32_t a3) { trace_write(id, 4, a0, a1, a2, a3); }
+
+//format one record as text (no newline), returns snprintf result
+int trace_format(const TraceRecord& r, char* buf, size_t len);
+
+//print records written since the last drain, returns how many were printed
+size_t trace_drain_to_uart();
+
+//copy every record still in the rings (oldest may be partly overwritten already) into buf as a dump
+//returns bytes written, buf needs trace_dump_capacity() bytes
+size_t trace_dump(uint8_t* buf, size_t len);
+size_t trace_dump_capacity();
+
+uint32_t trace_lost();
+
+//low priority task draining the rings to the console every period_ms (pvParameters = period as intptr_t)
+void trace_task(void* pvParameters);
+
+//time trace() against ESP_LOGI on this target and log the result, clears the rings afterwards
+void trace_measure();
@@ -0,0 +1,16 @@
+//trace message table: record ids are the position in this list
+//append only, dumps store ids not text (tools/trace_decode.py reads this file)
+//arguments are 32 bit ints, use %d/%u/%x conversions only
+TRACE_FORMAT(TRACE_PED_STILL, "Pedestrian still in frame at (%d, %d)")
+TRACE_FORMAT(TRACE_PED_EXITED, "Pedestrian exited at (%d, %d)")
+TRACE_FORMAT(TRACE_PED_ENTERED, "Pedestrian entered at (%d, %d)")
+TRACE_FORMAT(TRACE_PED_LOST, "Pedestrian lost at (%d, %d)")
+TRACE_FORMAT(TRACE_PED_LEFT, "Pedestrian left the frame at (%d, %d)")
+TRACE_FORMAT(TRACE_PED_RECOVERED, "Pedestrian recovered at (%d, %d) after %d ms")
+TRACE_FORMAT(TRACE_ENTRY_RECORDED, "Recorded movement event: entry at %u")
+TRACE_FORMAT(TRACE_EXIT_RECORDED, "Recorded movement event: exit at %u")
+TRACE_FORMAT(TRACE_MOVEMENT_DROPPED, "Movement queue full, event at %u dropped")
+TRACE_FORMAT(TRACE_REPORT_QUEUED, "Queued movement event %d")
+TRACE_FORMAT(TRACE_REPORTING, "Reporting %d movement events")
+TRACE_FORMAT(TRACE_REPORT_IDLE, "No movement events this cycle")
+TRACE_FORMAT(TRACE_SELF_TEST, "trace self test %d %d %d")
@@ -0,0 +1,203 @@
+#include "tracker.hpp"
+
+#include <stdlib.h>
+#include "trace.hpp"
+
+std::vector<Pedestrian> currentPedestrians;
+
+//tracks that disappeared recently, kept so they can be picked up again after an occlusion
+struct LostPedestrian {
+    Pedestrian ped;
+    int64_t lostAtMs;
+};
+static LostPedestrian lostPedestrians[REID_MAX_LOST];
+static int lostCount = 0;
+
+static uint32_t s_next_track_id = 1;
+static uint32_t s_reid_recovered = 0;
+static uint32_t s_reid_expired = 0;
+static void (*s_crossing_handler)(int is_entry, int64_t captured_us) = nullptr;
+
+void tracker_set_crossing_handler(void (*handler)(int is_entry, int64_t captured_us))
+{
+    s_crossing_handler = handler;
+}
+
+//calculate centroid for x or y depending on input
+void calculateCentroid(Pedestrian* p1)
+{
+    int cx = (p1->x1 + p1->x2) / 2;
+    int cy = (p1->y1 + p1->y2) / 2;
+    p1->centroidX = cx;
+    p1->centroidY = cy;
+}
+
+//check if pedestrian is same as last frame
+//This is achieved by seeing if the centroids are closer enough especially on the X axis
+bool samePedestrian(const Pedestrian& p1, const Pedestrian& p2)
+{
+    int diffX = p1.centroidX - p2.centroidX;
+    int diffY = p1.centroidY - p2.centroidY;
+
+    //check if between ranges
+    return (abs(diffX) <= samePedestrianX) && (abs(diffY) <= samePedestrianY);
+}
+
+//add new pedestrians into current list (only apply this with a list that has been filtered for same pedestrians)
+void updatePedestrians(const std::vector<Pedestrian>& newPedestrians)
+{
+    currentPedestrians.insert(currentPedestrians.end(), newPedestrians.begin(), newPedestrians.end());
+}
+
+//record entry/exit if centroid moved across the line between two sightings
+static void checkLineCrossing(const Pedestrian& before, const Pedestrian& after, int64_t capturedUs)
+{
+    if ((before.centroidY > LineY) && (after.centroidY <= LineY)) {
+        trace(TRACE_PED_EXITED, after.centroidX, after.centroidY);
+        if (s_crossing_handler) s_crossing_handler(0, capturedUs); //exit
+    } else if ((before.centroidY < LineY) && (after.centroidY >= LineY)) {
+        trace(TRACE_PED_ENTERED, after.centroidX, after.centroidY);
+        if (s_crossing_handler) s_crossing_handler(1, capturedUs); //entry
+    }
+}
+
+//forget lost tracks older than the window, those really left the frame
+static void expireLostPedestrians(int64_t nowMs)
+{
+    int kept = 0;
+    for (int i = 0; i < lostCount; i++) {
+        if (nowMs - lostPedestrians[i].lostAtMs > REID_WINDOW_MS) {
+            trace(TRACE_PED_LEFT, lostPedestrians[i].ped.centroidX, lostPedestrians[i].ped.centroidY);
+            s_reid_expired++;
+            continue;
+        }
+        lostPedestrians[kept++] = lostPedestrians[i];
+    }
+    lostCount = kept;
+}
+
+static void rememberLostPedestrian(const Pedestrian& p, int64_t nowMs)
+{
+    //full: drop the oldest, it is the least likely to come back
+    if (lostCount == REID_MAX_LOST) {
+        trace(TRACE_PED_LEFT, lostPedestrians[0].ped.centroidX, lostPedestrians[0].ped.centroidY);
+        s_reid_expired++;
+        for (int i = 1; i < lostCount; i++) {
+            lostPedestrians[i - 1] = lostPedestrians[i];
+        }
+        lostCount--;
+    }
+    lostPedestrians[lostCount].ped = p;
+    lostPedestrians[lostCount].lostAtMs = nowMs;
+    lostCount++;
+}
+
+//best matching lost track for a new detection (-1 if none is close and similar enough)
+static int findLostPedestrian(const Pedestrian& p)
+{
+    int best = -1;
+    float bestSimilarity = REID_MIN_SIMILARITY;
+    for (int i = 0; i < lostCount; i++) {
+        const Pedestrian& lost = lostPedestrians[i].ped;
+        if (abs(lost.centroidX - p.centroidX) > REID_MAX_DISTANCE || abs(lost.centroidY - p.centroidY) > REID_MAX_DISTANCE) {
+            continue;
+        }
+        float similarity = appearanceSimilarity(lost.appearance, p.appearance);
+        if (similarity >= bestSimilarity) {
+            bestSimilarity = similarity;
+            best = i;
+        }
+    }
+    return best;
+}
+
+//remove non existent pedestrians & check for crossing the line
+void prunePedestrians(const std::vector<Pedestrian>& newPedestrians, int64_t capturedUs)
+{
+    std::vector<Pedestrian> updatedPedestrians;
+    int64_t nowMs = capturedUs / 1000;
+
+    expireLostPedestrians(nowMs);
+
+    for (auto& oldPed : currentPedestrians) {
+        bool found = false;
+        for (auto& newPed : newPedestrians) {
+            if (samePedestrian(oldPed, newPed)) {
+                found = true;
+                //keep a smoothed signature so one partly hidden box does not replace it
+                Pedestrian tracked = newPed;
+                tracked.trackId = oldPed.trackId;
+                tracked.prevCentroidX = oldPed.centroidX;
+                tracked.prevCentroidY = oldPed.centroidY;
+                tracked.appearance = oldPed.appearance;
+                blendAppearance(&tracked.appearance, newPed.appearance);
+                updatedPedestrians.push_back(tracked);
+                //print found new ped
+                trace(TRACE_PED_STILL, newPed.centroidX, newPed.centroidY);
+                //check if crossed the line
+                checkLineCrossing(oldPed, newPed, capturedUs);
+                break;
+            }
+        }
+        //if not found it is either hidden or has left the frame, keep it around for a while
+        if (!found) {
+            trace(TRACE_PED_LOST, oldPed.centroidX, oldPed.centroidY);
+            rememberLostPedestrian(oldPed, nowMs);
+        }
+    }
+
+    currentPedestrians = updatedPedestrians;
+}
+
+//get new filtered pedestrians in the new list that arent already in the current list
+//detections matching a recently lost track continue that track instead of starting a new one
+std::vector<Pedestrian> filterNewPedestrians(const std::vector<Pedestrian>& newPedestrians, int64_t capturedUs)
+{
+    std::vector<Pedestrian> filteredPedestrians;
+
+    for (const auto& newPed : newPedestrians) {
+        bool isNew = true;
+        for (const auto& currPed : currentPedestrians) {
+            if (samePedestrian(newPed, currPed)) {
+                isNew = false;
+                break;
+            }
+        }
+        if (!isNew) {
+            continue;
+        }
+
+        Pedestrian ped = newPed;
+        int lost = findLostPedestrian(ped);
+        if (lost >= 0) {
+            const Pedestrian& before = lostPedestrians[lost].ped;
+            trace(TRACE_PED_RECOVERED, ped.centroidX, ped.centroidY, (int32_t)(capturedUs / 1000 - lostPedestrians[lost].lostAtMs));
+            //count a crossing that happened while hidden
+            checkLineCrossing(before, ped, capturedUs);
+            ped.trackId = before.trackId;
+            ped.prevCentroidX = before.centroidX;
+            ped.prevCentroidY = before.centroidY;
+            ped.appearance = before.appearance;
+            blendAppearance(&ped.appearance, newPed.appearance);
+            //keep oldest first order
+            for (int i = lost + 1; i < lostCount; i++) {
+                lostPedestrians[i - 1] = lostPedestrians[i];
+            }
+            lostCount--;
+            s_reid_recovered++;
+        } else {
+            ped.trackId = s_next_track_id++;
+        }
+        filteredPedestrians.push_back(ped);
+    }
+
+    return filteredPedestrians;
+}
+
+TrackerStats tracker_take_stats()
+{
+    TrackerStats stats = {s_reid_recovered, s_reid_expired, lostCount};
+    s_reid_recovered = 0;
+    s_reid_expired = 0;
+    return stats;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "appearance.hpp"
+
+//centroid tracker: matches detections to the tracks of the previous frame, counts line crossings
+//and picks up tracks lost behind shelves or other people by colour signature
+//no esp-idf dependencies, tools/tracker_occlusion_test.cpp runs it on the host
+
+//marker line to figure out if user entered or exited
+#define LineY 60
+
+//Range in which centroid assumes its the same pedestrian
+#define samePedestrianX 10
+#define samePedestrianY 15
+
+//recovering tracks lost behind shelves or other people
+#define REID_WINDOW_MS 2000       //how long a lost track can still be picked up again
+#define REID_MAX_LOST 8           //lost tracks kept at once (oldest dropped first)
+#define REID_MIN_SIMILARITY 0.6f  //colour histogram intersection needed to re-associate
+#define REID_MAX_DISTANCE 40      //max centroid jump in pixels while hidden
+
+struct Pedestrian {
+    int x1;
+    int x2;
+    int y1;
+    int y2;
+    int centroidX;
+    int centroidY;
+    int prevCentroidX; //where the track was in the previous frame (walking direction)
+    int prevCentroidY;
+    uint32_t trackId;  //0 for a fresh detection, set once it becomes or continues a track
+    Appearance appearance;
+
+    Pedestrian() = default;
+
+    Pedestrian& operator=(const Pedestrian& other) = default;
+};
+
+//recovered/left counts since the last tracker_take_stats()
+struct TrackerStats {
+    uint32_t recovered;
+    uint32_t expired;
+    int lost_now;
+};
+
+//tracks of the last processed frame
+extern std::vector<Pedestrian> currentPedestrians;
+
+//called for every line crossing (is_entry 1 = entry, 0 = exit) with the frame's capture time
+void tracker_set_crossing_handler(void (*handler)(int is_entry, int64_t captured_us));
+
+void calculateCentroid(Pedestrian* p1);
+bool samePedestrian(const Pedestrian& p1, const Pedestrian& p2);
+
+//per frame, in this order: filterNewPedestrians, prunePedestrians, updatePedestrians
+std::vector<Pedestrian> filterNewPedestrians(const std::vector<Pedestrian>& newPedestrians, int64_t capturedUs);
+void prunePedestrians(const std::vector<Pedestrian>& newPedestrians, int64_t capturedUs);
+void updatePedestrians(const std::vector<Pedestrian>& newPedestrians);
+
+TrackerStats tracker_take_stats();
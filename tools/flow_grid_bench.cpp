@@ -0,0 +1,75 @@
+//host benchmark for main/flow_grid.hpp: memory is fixed and the per frame cost only grows with the
+//number of people in view, not with how long the grid has been collecting or how busy it has been
+//build: g++ -O2 -std=c++17 -Imain tools/flow_grid_bench.cpp -o flow_grid_bench && ./flow_grid_bench
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "flow_grid.hpp"
+
+struct Walker {
+    int x;
+    int y;
+    int dx;
+    int dy;
+};
+
+//ns per frame for `people` walkers over `frames` frames (what ml_task does after tracking)
+static double run(FlowGrid& grid, int people, int frames, unsigned seed)
+{
+    srand(seed);
+    std::vector<Walker> walkers(people);
+    for (auto& w : walkers) {
+        w = {rand() % 160, rand() % 120, rand() % 7 - 3, rand() % 7 - 3};
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        for (auto& w : walkers) {
+            int px = w.x;
+            int py = w.y;
+            w.x = (w.x + w.dx + 160) % 160;
+            w.y = (w.y + w.dy + 120) % 120;
+            grid.occupy(w.x, w.y, 200);
+            grid.step(px, py, w.x, w.y);
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / frames;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 200000;
+
+    FlowGrid grid;
+    grid.init(160, 120);
+    printf("FlowGrid: %dx%d cells, %zu bytes (x2 double buffered on device), snapshot <= %zu bytes\n",
+           FlowGrid::COLS, FlowGrid::ROWS, sizeof(FlowGrid), FlowGrid::json_capacity());
+
+    printf("%8s %12s %14s\n", "people", "ns/frame", "ns/person");
+    for (int people : {0, 1, 2, 4, 8, 16, 32}) {
+        grid.clear();
+        double ns = run(grid, people, frames, 1);
+        printf("%8d %12.1f %14.1f\n", people, ns, people ? ns / people : 0.0);
+    }
+
+    //same load after a long busy period: cost must not drift as counters fill up
+    grid.clear();
+    double fresh = run(grid, 8, frames, 2);
+    run(grid, 32, frames * 5, 3);
+    double busy = run(grid, 8, frames, 2);
+    printf("8 people: fresh grid %.1f ns/frame, after %d busy frames %.1f ns/frame\n", fresh, frames * 5, busy);
+
+    //snapshot cost and size with every cell populated
+    std::vector<char> buf(FlowGrid::json_capacity());
+    auto t0 = std::chrono::steady_clock::now();
+    size_t len = 0;
+    for (int i = 0; i < 1000; i++) {
+        len = grid.to_json(buf.data(), buf.size(), 1700000000, 1700000060);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    printf("snapshot: %zu bytes in %.1f us\n", len, std::chrono::duration<double, std::micro>(t1 - t0).count() / 1000);
+    return len ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+//host check for main/motion_blob.hpp (the motion detector backend): a person who stood still and
+//walked away must not stay reported where they stood, and people walking must still be found
+//build: g++ -O2 -std=c++17 -Imain tools/motion_ghost_test.cpp -o motion_ghost_test && ./motion_ghost_test
+//exit status 1 when the ghost outlives MAX_GHOST_FRAMES or B or C is missed in more than 1 in 10 frames
+//(A is only reported: right after standing, the background holds A, so A's blob splits for a few frames)
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "motion_blob.hpp"
+
+static const int WIDTH = 160;
+static const int HEIGHT = 120;
+static const int PERSON_W = 16;
+static const int PERSON_H = 40;
+static const float MIN_FILL = 0.3f; //MOTION_MIN_FILL in detector.cpp
+static const int MAX_GHOST_FRAMES = 30; //3 s at 10 fps
+
+struct Rect {
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+};
+
+static uint16_t rgb565(int r, int g, int b)
+{
+    r = r < 0 ? 0 : r > 255 ? 255 : r;
+    g = g < 0 ? 0 : g > 255 ? 255 : g;
+    b = b < 0 ? 0 : b > 255 ? 255 : b;
+    return (uint16_t)(((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+}
+
+//floor texture plus sensor noise, a person is a shirt over trousers or plain (one colour)
+static void render(std::vector<uint8_t>& frame, const std::vector<uint8_t>& floor, const std::vector<Rect>& people,
+                   const std::vector<bool>& plain)
+{
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            int l = floor[y * WIDTH + x] + rand() % 7 - 3;
+            int r = l, g = l, b = l - 10;
+            for (size_t i = 0; i < people.size(); i++) {
+                const Rect& p = people[i];
+                if (x < p.x1 || x >= p.x2 || y < p.y1 || y >= p.y2) continue;
+                bool shirt = plain[i] || y < p.y1 + PERSON_H / 2;
+                r = (shirt ? 160 : 40) + rand() % 7 - 3;
+                g = (shirt ? 30 : 40) + rand() % 7 - 3;
+                b = (shirt ? 30 : 80) + rand() % 7 - 3;
+            }
+            uint16_t c = rgb565(r, g, b);
+            frame[(y * WIDTH + x) * 2] = c >> 8; //camera byte order
+            frame[(y * WIDTH + x) * 2 + 1] = c & 0xff;
+        }
+    }
+}
+
+static bool overlaps(const MotionBlob::Box& b, const Rect& r)
+{
+    return b.x1 < r.x2 && r.x1 < b.x2 && b.y1 < r.y2 && r.y1 < b.y2;
+}
+
+static bool contains(const MotionBlob::Box& b, const Rect& r)
+{
+    int cx = (r.x1 + r.x2) / 2;
+    int cy = (r.y1 + r.y2) / 2;
+    return cx >= b.x1 && cx < b.x2 && cy >= b.y1 && cy < b.y2;
+}
+
+int main()
+{
+    srand(3);
+    std::vector<uint8_t> floor(WIDTH * HEIGHT);
+    for (auto& l : floor) {
+        l = 110 + rand() % 30;
+    }
+
+    //person A walks in from the top, stands at the shelf for 20 s (10 fps), walks out at the bottom
+    //person B keeps walking up and down in another lane the whole time, person C too but slowly
+    //and in plain clothes, so the inside of C looks the same for many frames
+    const int STAND_X = 40;
+    const int STAND_Y = 40;
+    const int ARRIVE = 10 + (STAND_Y + PERSON_H) / 2;
+    const int LEAVE = ARRIVE + 200;
+    const int FRAMES = LEAVE + 250;
+    const Rect spot = {STAND_X, STAND_Y, STAND_X + PERSON_W, STAND_Y + PERSON_H};
+
+    MotionBlob grid;
+    std::vector<MotionBlob::Box> boxes;
+    std::vector<uint8_t> frame(WIDTH * HEIGHT * 2);
+    const char* names[] = {"A", "B", "C"};
+    int walking_frames[3] = {};
+    int walking_found[3] = {};
+    int standing_reported = 0;
+    int ghost_frames = 0;
+    int ghost_last = -1;
+    double detect_us = 0;
+    for (int f = 0; f < FRAMES; f++) {
+        std::vector<Rect> people;
+        std::vector<bool> walking;
+        std::vector<bool> plain;
+        std::vector<int> who;
+
+        int ay = f < ARRIVE ? -PERSON_H + (f - 10) * 2 : f < LEAVE ? STAND_Y : STAND_Y + (f - LEAVE) * 2;
+        bool a_visible = f >= 10 && ay < HEIGHT;
+        if (a_visible) {
+            people.push_back({STAND_X, ay, STAND_X + PERSON_W, ay + PERSON_H});
+            walking.push_back(f < ARRIVE || f >= LEAVE);
+            plain.push_back(false);
+            who.push_back(0);
+        }
+        int period = 2 * (HEIGHT + PERSON_H);
+        int phase = (f * 3) % period;
+        int by = phase < period / 2 ? -PERSON_H + phase : HEIGHT - (phase - period / 2);
+        people.push_back({110, by, 110 + PERSON_W, by + PERSON_H});
+        walking.push_back(true);
+        plain.push_back(false);
+        who.push_back(1);
+        phase = f % period;
+        int cy = phase < period / 2 ? -PERSON_H + phase : HEIGHT - (phase - period / 2);
+        people.push_back({80, cy, 80 + PERSON_W, cy + PERSON_H});
+        walking.push_back(true);
+        plain.push_back(true);
+        who.push_back(2);
+
+        render(frame, floor, people, plain);
+        auto t0 = std::chrono::steady_clock::now();
+        grid.detect(frame.data(), WIDTH, HEIGHT, MIN_FILL, boxes);
+        detect_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        if (f == 0) continue; //first frame only primes the background
+
+        for (size_t i = 0; i < people.size(); i++) {
+            const Rect& p = people[i];
+            //walkers fully in view must be found
+            if (walking[i] && p.y1 >= 0 && p.y2 <= HEIGHT) {
+                walking_frames[who[i]]++;
+                for (const auto& b : boxes) {
+                    if (contains(b, p)) {
+                        walking_found[who[i]]++;
+                        break;
+                    }
+                }
+            }
+        }
+        bool a_at_spot = a_visible && ay < spot.y2 && ay + PERSON_H > spot.y1;
+        for (const auto& b : boxes) {
+            if (!overlaps(b, spot)) continue;
+            if (f >= ARRIVE && f < LEAVE) {
+                standing_reported++;
+            } else if (f >= LEAVE && !a_at_spot) {
+                ghost_frames++;
+                ghost_last = f;
+            }
+            break;
+        }
+    }
+    int a_gone = LEAVE + (spot.y2 - STAND_Y) / 2;
+
+    printf("state %zu bytes, %.1f us per %dx%d frame\n", MotionBlob::state_bytes(), detect_us / FRAMES, WIDTH, HEIGHT);
+    bool ok = ghost_last < 0 || ghost_last - a_gone <= MAX_GHOST_FRAMES;
+    for (int i = 0; i < 3; i++) {
+        printf("walker %s found in %d of %d frames\n", names[i], walking_found[i], walking_frames[i]);
+        ok = ok && (i == 0 || walking_found[i] * 10 >= walking_frames[i] * 9);
+    }
+    printf("standing person reported for %d of %d frames\n", standing_reported, LEAVE - ARRIVE);
+    printf("ghost after leaving: %d frames reported, last %d frames after the person cleared the spot\n", ghost_frames,
+           ghost_last < 0 ? 0 : ghost_last - a_gone);
+    return ok ? 0 : 1;
+}
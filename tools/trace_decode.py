@@ -0,0 +1,84 @@
+#decode a binary trace dump from the device into text
+#usage: curl -s http://<esp-ip>/trace -o trace.bin && python tools/trace_decode.py trace.bin
+#message formats come from main/trace_formats.h (record id = line order there)
+import argparse
+import os
+import re
+import struct
+import sys
+
+HEADER = struct.Struct("<4sHHII")
+RECORD = struct.Struct("<qIHBB4i")
+FORMATS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "main", "trace_formats.h")
+SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?([diuxXc%])")
+
+
+def load_formats(path):
+    with open(path) as f:
+        text = f.read()
+    return [
+        (name, bytes(fmt, "utf-8").decode("unicode_escape"))
+        for name, fmt in re.findall(r'^TRACE_FORMAT\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text, re.M)
+    ]
+
+#printf with 32 bit int arguments, unsigned conversions see the raw bits
+def format_message(fmt, args):
+    values = iter(args)
+
+    def convert(match):
+        kind = match.group(1)
+        if kind == "%":
+            return "%"
+        value = next(values, 0)
+        if kind in "uxX":
+            value &= 0xFFFFFFFF
+        spec = match.group(0)
+        if kind == "u":
+            spec = spec[:-1] + "d"
+        return spec % value
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(data, formats):
+    magic, record_size, format_count, count, lost = HEADER.unpack_from(data, 0)
+    if magic != b"TRC1":
+        raise ValueError("not a trace dump")
+    if record_size != RECORD.size:
+        raise ValueError(f"record size {record_size}, this decoder expects {RECORD.size}")
+    if format_count != len(formats):
+        print(f"warning: device has {format_count} formats, {FORMATS} has {len(formats)}", file=sys.stderr)
+
+    records = []
+    for i in range(count):
+        time_us, seq, msg_id, nargs, core, *args = RECORD.unpack_from(data, HEADER.size + i * record_size)
+        records.append((time_us, core, seq, msg_id, args[:nargs]))
+    records.sort()
+    return records, lost
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("dump")
+    parser.add_argument("--formats", default=FORMATS)
+    parser.add_argument("--ids", action="store_true", help="prefix lines with the message id name")
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    with open(args.dump, "rb") as f:
+        records, lost = decode(f.read(), formats)
+
+    for time_us, core, _, msg_id, values in records:
+        if msg_id < len(formats):
+            name, fmt = formats[msg_id]
+            text = format_message(fmt, values)
+        else:
+            name, text = "?", f"unknown trace id {msg_id} {values}"
+        prefix = f"{name} " if args.ids else ""
+        print(f"[{time_us // 1000000}.{time_us % 1000000:06d} c{core}] {prefix}{text}")
+    if lost:
+        print(f"({lost} records were overwritten before the device printed them)", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
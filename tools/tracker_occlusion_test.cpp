@@ -0,0 +1,290 @@
+//host accuracy/timing test for the tracker (main/tracker.cpp) and its colour signature re-id
+//(main/appearance.hpp) on clips with occlusions
+//build: g++ -O2 -std=c++17 -Imain tools/tracker_occlusion_test.cpp main/tracker.cpp -o tracker_occlusion_test
+//run:   ./tracker_occlusion_test                          built-in synthetic clip (people hidden by shelves)
+//       ./tracker_occlusion_test clip.txt [clip.rgb565]   recorded clip
+//       ./tracker_occlusion_test --write clip             save the built-in clip in that format
+//clip.txt: one annotated box per line "frame id x1 y1 x2 y2" (frame from 0, id = person, # comments),
+//a person missing from frames is hidden; clip.rgb565: the frames as REPLAY_RGB565 (camera byte order),
+//without it each person is drawn as a flat box in a colour of its own
+//exit status 1 when a person switches track or the counted entries/exits differ from the annotated ones
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "tracker.hpp"
+#include "trace.hpp"
+
+//tracker traces go nowhere on the host
+void trace_write(TraceId, int, int32_t, int32_t, int32_t, int32_t) {}
+
+static const int WIDTH = 160;
+static const int HEIGHT = 120;
+static const int FPS = 10;
+
+struct Box {
+    int frame;
+    int id;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+};
+
+struct Clip {
+    std::vector<Box> boxes;        //ascending by frame
+    std::vector<uint8_t> pixels;   //frames * WIDTH * HEIGHT * 2, may be empty
+    int frames = 0;
+};
+
+static void put_pixel(uint8_t* frame, int x, int y, uint16_t color)
+{
+    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) return;
+    uint8_t* px = frame + ((size_t)y * WIDTH + x) * 2;
+    px[0] = color >> 8; //camera byte order, high byte first
+    px[1] = color & 0xff;
+}
+
+static void fill(uint8_t* frame, int x1, int y1, int x2, int y2, uint16_t color)
+{
+    for (int y = y1; y < y2; y++) {
+        for (int x = x1; x < x2; x++) {
+            put_pixel(frame, x, y, color);
+        }
+    }
+}
+
+static uint16_t rgb565(int r, int g, int b)
+{
+    return (uint16_t)(((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+}
+
+//four people crossing the line, two of them hidden behind shelves while they cross
+static Clip synthetic_clip()
+{
+    struct Walker {
+        int id;
+        int x;       //left edge
+        int y;       //top at start
+        int dy;      //pixels per frame
+        int start;
+        int hidden_from;
+        int hidden_to;
+        uint16_t shirt;
+        uint16_t trousers;
+    };
+    const Walker walkers[] = {
+        {1, 30, -10, 2, 0, 18, 25, rgb565(220, 40, 40), rgb565(40, 40, 60)},    //down, hidden at the line
+        {2, 110, 110, -2, 5, 22, 29, rgb565(40, 80, 220), rgb565(200, 200, 170)}, //up, hidden at the line
+        {3, 70, -10, 3, 30, -1, -1, rgb565(40, 180, 60), rgb565(60, 40, 30)},    //down, always visible
+        {4, 34, 110, -2, 50, 68, 72, rgb565(230, 200, 40), rgb565(30, 30, 30)},  //up, same lane as 1
+    };
+    const int boxW = 20;
+    const int boxH = 40;
+
+    Clip clip;
+    clip.frames = 110;
+    clip.pixels.resize((size_t)clip.frames * WIDTH * HEIGHT * 2);
+    srand(7);
+    for (int f = 0; f < clip.frames; f++) {
+        uint8_t* frame = clip.pixels.data() + (size_t)f * WIDTH * HEIGHT * 2;
+        //floor with shelves along the sides
+        fill(frame, 0, 0, WIDTH, HEIGHT, rgb565(128, 128, 120));
+        fill(frame, 0, 0, 12, HEIGHT, rgb565(90, 70, 50));
+        fill(frame, WIDTH - 12, 0, WIDTH, HEIGHT, rgb565(90, 70, 50));
+        for (const auto& w : walkers) {
+            if (f < w.start) continue;
+            int top = w.y + (f - w.start) * w.dy;
+            if (top + boxH <= 0 || top >= HEIGHT) continue;
+            if (f >= w.hidden_from && f <= w.hidden_to) continue;
+            //detector boxes wobble by a pixel or two
+            int jx = rand() % 3 - 1;
+            int jy = rand() % 3 - 1;
+            Box b = {f, w.id, w.x + jx, top + jy, w.x + jx + boxW, top + jy + boxH};
+            fill(frame, b.x1 + 2, b.y1, b.x2 - 2, b.y1 + boxH / 2, w.shirt);
+            fill(frame, b.x1 + 4, b.y1 + boxH / 2, b.x2 - 4, b.y2, w.trousers);
+            if (b.y1 < 0) b.y1 = 0;
+            if (b.y2 > HEIGHT) b.y2 = HEIGHT;
+            clip.boxes.push_back(b);
+        }
+    }
+    return clip;
+}
+
+static bool load_clip(const char* boxes_path, const char* frames_path, Clip& clip)
+{
+    FILE* f = fopen(boxes_path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", boxes_path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        Box b;
+        if (line[0] == '#' || sscanf(line, "%d %d %d %d %d %d", &b.frame, &b.id, &b.x1, &b.y1, &b.x2, &b.y2) != 6) {
+            continue;
+        }
+        clip.boxes.push_back(b);
+        if (b.frame + 1 > clip.frames) clip.frames = b.frame + 1;
+    }
+    fclose(f);
+    std::stable_sort(clip.boxes.begin(), clip.boxes.end(), [](const Box& a, const Box& b) { return a.frame < b.frame; });
+
+    if (frames_path) {
+        f = fopen(frames_path, "rb");
+        if (!f) {
+            fprintf(stderr, "cannot open %s\n", frames_path);
+            return false;
+        }
+        clip.pixels.resize((size_t)clip.frames * WIDTH * HEIGHT * 2);
+        size_t got = fread(clip.pixels.data(), 1, clip.pixels.size(), f);
+        fclose(f);
+        if (got != clip.pixels.size()) {
+            fprintf(stderr, "%s holds %zu of %d frames\n", frames_path, got / (WIDTH * HEIGHT * 2), clip.frames);
+            return false;
+        }
+        return true;
+    }
+
+    //no footage: a flat colour per person is enough for the signatures to tell them apart
+    clip.pixels.resize((size_t)clip.frames * WIDTH * HEIGHT * 2);
+    for (int i = 0; i < clip.frames; i++) {
+        fill(clip.pixels.data() + (size_t)i * WIDTH * HEIGHT * 2, 0, 0, WIDTH, HEIGHT, rgb565(128, 128, 128));
+    }
+    for (const auto& b : clip.boxes) {
+        unsigned h = (unsigned)b.id * 2654435761u;
+        fill(clip.pixels.data() + (size_t)b.frame * WIDTH * HEIGHT * 2, b.x1, b.y1, b.x2, b.y2,
+             rgb565(h >> 24, (h >> 16) & 0xff, (h >> 8) & 0xff));
+    }
+    return true;
+}
+
+static bool write_clip(const Clip& clip, const char* prefix)
+{
+    std::string boxes_path = std::string(prefix) + ".txt";
+    std::string frames_path = std::string(prefix) + ".rgb565";
+    FILE* f = fopen(boxes_path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "#frame id x1 y1 x2 y2\n");
+    for (const auto& b : clip.boxes) {
+        fprintf(f, "%d %d %d %d %d %d\n", b.frame, b.id, b.x1, b.y1, b.x2, b.y2);
+    }
+    fclose(f);
+    f = fopen(frames_path.c_str(), "wb");
+    if (!f) return false;
+    fwrite(clip.pixels.data(), 1, clip.pixels.size(), f);
+    fclose(f);
+    printf("wrote %s and %s (%d frames)\n", boxes_path.c_str(), frames_path.c_str(), clip.frames);
+    return true;
+}
+
+static int s_entries = 0;
+static int s_exits = 0;
+
+static void count_crossing(int is_entry, int64_t)
+{
+    if (is_entry) {
+        s_entries++;
+    } else {
+        s_exits++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Clip clip;
+    if (argc >= 3 && strcmp(argv[1], "--write") == 0) {
+        return write_clip(synthetic_clip(), argv[2]) ? 0 : 1;
+    }
+    if (argc >= 2) {
+        if (!load_clip(argv[1], argc >= 3 ? argv[2] : nullptr, clip)) return 1;
+        printf("clip: %s, %d frames, %zu boxes\n", argv[1], clip.frames, clip.boxes.size());
+    } else {
+        clip = synthetic_clip();
+        printf("clip: built-in, %d frames, %zu boxes\n", clip.frames, clip.boxes.size());
+    }
+
+    //crossings in the annotations, same rule as the tracker between consecutive sightings of a person
+    int true_entries = 0;
+    int true_exits = 0;
+    std::map<int, int> last_cy;
+    for (const auto& b : clip.boxes) {
+        int cy = (b.y1 + b.y2) / 2;
+        auto it = last_cy.find(b.id);
+        if (it != last_cy.end()) {
+            if (it->second > LineY && cy <= LineY) true_exits++;
+            if (it->second < LineY && cy >= LineY) true_entries++;
+        }
+        last_cy[b.id] = cy;
+    }
+
+    tracker_set_crossing_handler(count_crossing);
+
+    std::map<int, uint32_t> track_of;    //person -> track that had it last
+    std::map<uint32_t, bool> tracks_seen;
+    int id_switches = 0;
+    uint32_t recovered = 0;
+    double descriptor_us = 0;
+    double tracker_us = 0;
+    size_t next = 0;
+    for (int f = 0; f < clip.frames; f++) {
+        const uint8_t* frame = clip.pixels.data() + (size_t)f * WIDTH * HEIGHT * 2;
+        int64_t captured_us = (int64_t)f * 1000000 / FPS;
+
+        //detections as run_pedestrian_detect builds them
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<Pedestrian> detections;
+        std::vector<int> person;
+        for (; next < clip.boxes.size() && clip.boxes[next].frame == f; next++) {
+            const Box& b = clip.boxes[next];
+            Pedestrian p;
+            p.x1 = b.x1;
+            p.y1 = b.y1;
+            p.x2 = b.x2;
+            p.y2 = b.y2;
+            calculateCentroid(&p);
+            p.prevCentroidX = p.centroidX;
+            p.prevCentroidY = p.centroidY;
+            p.trackId = 0;
+            computeAppearance(frame, WIDTH, HEIGHT, p.x1, p.y1, p.x2, p.y2, &p.appearance);
+            detections.push_back(p);
+            person.push_back(b.id);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        auto fresh = filterNewPedestrians(detections, captured_us);
+        prunePedestrians(detections, captured_us);
+        updatePedestrians(fresh);
+        auto t2 = std::chrono::steady_clock::now();
+        descriptor_us += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        tracker_us += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        recovered += tracker_take_stats().recovered;
+
+        //tracks carry the box of the detection they took this frame
+        for (size_t i = 0; i < detections.size(); i++) {
+            const Pedestrian& d = detections[i];
+            for (const auto& t : currentPedestrians) {
+                if (t.x1 != d.x1 || t.y1 != d.y1 || t.x2 != d.x2 || t.y2 != d.y2) continue;
+                auto it = track_of.find(person[i]);
+                if (it != track_of.end() && it->second != t.trackId) {
+                    id_switches++;
+                    printf("  frame %d: person %d moved from track %u to %u\n", f, person[i], it->second, t.trackId);
+                }
+                track_of[person[i]] = t.trackId;
+                tracks_seen[t.trackId] = true;
+                break;
+            }
+        }
+    }
+
+    printf("people %zu, tracks %zu, ID switches %d, recovered tracks %u\n", track_of.size(), tracks_seen.size(), id_switches,
+           (unsigned)recovered);
+    printf("entries %d (annotated %d), exits %d (annotated %d)\n", s_entries, true_entries, s_exits, true_exits);
+    printf("per frame: descriptors %.2f us, tracker %.2f us (%.1f boxes on average)\n", descriptor_us / clip.frames,
+           tracker_us / clip.frames, (double)clip.boxes.size() / clip.frames);
+    return (id_switches == 0 && s_entries == true_entries && s_exits == true_exits) ? 0 : 1;
+}